@@ -1,6 +1,6 @@
 /*
  * Scientific Calculator with Windows GUI
- * Build: gcc -o CalculatorGUI.exe CalculatorGUI.c -lm -mwindows
+ * Build: gcc -o CalculatorGUI.exe CalculatorGUI.c keypad.c calc.c -lm -mwindows
  */
 
 #define WIN32_LEAN_AND_MEAN
@@ -9,6 +9,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include "keypad.h"
 
 /* Theme colors */
 #define COL_BG          RGB(38, 40, 46)
@@ -22,9 +23,7 @@
 #define COL_BTN_MOD     RGB(114, 46, 209)
 #define COL_BTN_TEXT    RGB(255, 255, 255)
 #define COL_BTN_FUNC    RGB(90, 70, 140)   /* scientific functions */
-#include <math.h>
 
-#define PI 3.14159265358979323846
 #define IDC_EXPR      100
 #define IDC_DISPLAY   101
 #define IDC_FEEDBACK  102
@@ -62,25 +61,13 @@
 #define IDM_EDIT_HISTORY  3003
 #define IDM_HELP_ABOUT   3002
 
-#define MAX_DISPLAY   80
-#define MAX_HISTORY   50
-#define MAX_HIST_LINE 120
-#define MAX_EXPR      120
-
-static char display[MAX_DISPLAY] = "0";
-static char expression[MAX_EXPR] = "";
-static double operand1 = 0;
-static char pending_op = 0;
-static int fresh_display = 1;
-static int degree_mode = 1;  /* 1=deg, 0=rad */
+static keypad s_keypad;  /* display, pending operation and history */
 
 #define MAX_BUTTONS    40
 #define KEYPAD_COLS    4
 #define KEYPAD_ROWS    9
 
 static HWND hDisplay, hExpr, hFeedback;
-#define MAX_FEEDBACK   64
-static char last_result[MAX_FEEDBACK];  /* e.g. "Result: -5" for main-screen feedback */
 static HFONT hFontDisplay, hFontBtn;
 static HBRUSH hBrushBg, hBrushDisplay;
 static int minClientW = 280, minClientH = 420;
@@ -89,285 +76,80 @@ typedef struct { HWND h; int row; int col; } ButtonPlace;
 static ButtonPlace s_buttons[MAX_BUTTONS];
 static int s_button_count = 0;
 
-static char s_history[MAX_HISTORY][MAX_HIST_LINE];
-static int s_history_count = 0;
-
-static void add_history(const char *line)
-{
-    if (s_history_count >= MAX_HISTORY)
-    {
-        memmove(s_history[0], s_history[1], sizeof(s_history[0]) * (MAX_HISTORY - 1));
-        s_history_count = MAX_HISTORY - 1;
-    }
-    strncpy(s_history[s_history_count], line, MAX_HIST_LINE - 1);
-    s_history[s_history_count][MAX_HIST_LINE - 1] = '\0';
-    s_history_count++;
-}
-
 static void update_display(HWND hwnd)
 {
     (void)hwnd;
-    SetWindowTextA(hDisplay, display);
+    SetWindowTextA(hDisplay, s_keypad.display);
 }
 
 static void update_expression(HWND hwnd)
 {
     (void)hwnd;
-    SetWindowTextA(hExpr, expression);
+    SetWindowTextA(hExpr, s_keypad.expression);
 }
 
 static void update_feedback(HWND hwnd)
 {
     (void)hwnd;
     if (hFeedback)
-        SetWindowTextA(hFeedback, last_result);
+        SetWindowTextA(hFeedback, s_keypad.last_result);
 }
 
-static void append_digit(HWND hwnd, char digit)
+static void update_all(HWND hwnd)
 {
-    if (fresh_display)
-    {
-        display[0] = digit;
-        display[1] = '\0';
-        fresh_display = 0;
-    }
-    else
-    {
-        size_t len = strlen(display);
-        if (len < MAX_DISPLAY - 1)
-        {
-            display[len] = digit;
-            display[len + 1] = '\0';
-        }
-    }
     update_display(hwnd);
+    update_expression(hwnd);
+    update_feedback(hwnd);
 }
 
 static void append_dot(HWND hwnd)
 {
-    if (strchr(display, '.')) return;
-    size_t len = strlen(display);
-    if (len < MAX_DISPLAY - 1)
-    {
-        if (fresh_display) { display[0] = '0'; display[1] = '.'; display[2] = '\0'; fresh_display = 0; }
-        else { display[len] = '.'; display[len + 1] = '\0'; }
-    }
+    keypad_dot(&s_keypad);
     update_display(hwnd);
 }
 
-static double get_display_value(void)
-{
-    return atof(display);
-}
-
-static void set_display_value(double val)
-{
-    /* Format so negative numbers (e.g. -5) show clearly on main screen */
-    snprintf(display, MAX_DISPLAY, "%.12g", val);
-    char *p = strchr(display, '.');
-    if (p)
-    {
-        size_t len = strlen(p);
-        while (len > 1 && p[len - 1] == '0') { p[--len] = '\0'; }
-        if (len == 1) *p = '\0';
-    }
-    /* Main-screen feedback: show this number as result (e.g. "Result: -5") */
-    snprintf(last_result, MAX_FEEDBACK, "Result: %s", display);
-    fresh_display = 1;
-}
-
-static void set_expression(const char *op_str)
-{
-    if (op_str && *op_str)
-        snprintf(expression, MAX_EXPR, "%.10g %s ", operand1, op_str);
-    else
-        expression[0] = '\0';
-}
-
-static double to_rad(double deg) { return deg * PI / 180.0; }
-
 static void do_operation(HWND hwnd, char op)
 {
-    double b = get_display_value();
-    double result = 0;
-    int error = 0;
-
-    if (pending_op)
-    {
-        double a = operand1;
-        switch (pending_op)
-        {
-            case '+': result = a + b; break;
-            case '-': result = a - b; break;
-            case '*': result = a * b; break;
-            case '/':
-                if (b == 0) { error = 1; break; }
-                result = a / b;
-                break;
-            case '%':
-                if ((long)b == 0) { error = 1; break; }
-                result = (double)((long)a % (long)b);
-                break;
-            case '^':
-                result = pow(a, b);
-                break;
-            default: break;
-        }
-        if (!error)
-        {
-            set_display_value(result);
-            update_display(hwnd);
-            update_feedback(hwnd);
-            if (op == '=')
-            {
-                char hist[MAX_HIST_LINE];
-                const char *opc = (pending_op == '*') ? "*" : (pending_op == '/') ? "/" :
-                    (pending_op == '%') ? "%" : (pending_op == '+') ? "+" :
-                    (pending_op == '-') ? "-" : "^";
-                snprintf(hist, sizeof(hist), "%.10g %s %.10g = %.12g", operand1, opc, b, result);
-                add_history(hist);
-            }
-        }
-    }
-    else
-    {
-        operand1 = b;
-    }
-
-    if (error)
-    {
+    if (keypad_operator(&s_keypad, op) != 0)
         MessageBoxA(hwnd, "Division by zero.", "Error", MB_OK | MB_ICONERROR);
-        strcpy(display, "0");
-        fresh_display = 1;
-        pending_op = 0;
-        expression[0] = '\0';
-        update_display(hwnd);
-        update_expression(hwnd);
-        return;
-    }
-
-    if (op == '=')
-    {
-        pending_op = 0;
-        expression[0] = '\0';
-        update_expression(hwnd);
-    }
-    else
-    {
-        pending_op = op;
-        operand1 = get_display_value();
-        fresh_display = 1;
-        const char *s = (op == '*') ? "*" : (op == '/') ? "/" : (op == '%') ? "%" :
-                       (op == '+') ? "+" : (op == '-') ? "-" : "^";
-        set_expression(s);
-        update_expression(hwnd);
-    }
+    update_all(hwnd);
 }
 
-static const char* unary_func_name(int op_id)
+static int unary_func(int op_id)
 {
     switch (op_id)
     {
-        case IDC_BTN_SQRT: return "sqrt";
-        case IDC_BTN_X2:   return "x^2";
-        case IDC_BTN_1X:   return "1/x";
-        case IDC_BTN_SIN:  return "sin";
-        case IDC_BTN_COS:  return "cos";
-        case IDC_BTN_TAN:  return "tan";
-        case IDC_BTN_LN:   return "ln";
-        case IDC_BTN_LOG:  return "log";
-        case IDC_BTN_EXP:  return "exp";
-        case IDC_BTN_ABS:  return "abs";
-        case IDC_BTN_PI:   return "pi";
-        case IDC_BTN_EE:   return "e";
-        case IDC_BTN_INV:  return "asin";
-        default: return "?";
+        case IDC_BTN_SQRT: return KP_SQRT;
+        case IDC_BTN_X2:   return KP_SQUARE;
+        case IDC_BTN_1X:   return KP_RECIP;
+        case IDC_BTN_SIN:  return KP_SIN;
+        case IDC_BTN_COS:  return KP_COS;
+        case IDC_BTN_TAN:  return KP_TAN;
+        case IDC_BTN_LN:   return KP_LN;
+        case IDC_BTN_LOG:  return KP_LOG;
+        case IDC_BTN_EXP:  return KP_EXP;
+        case IDC_BTN_ABS:  return KP_ABS;
+        case IDC_BTN_PI:   return KP_PI;
+        case IDC_BTN_EE:   return KP_E;
+        case IDC_BTN_INV:  return KP_ASIN;
+        default: return -1;
     }
 }
 
 static void do_unary(HWND hwnd, int op_id)
 {
-    double x = get_display_value();
-    double result = 0;
-    int error = 0;
-
-    switch (op_id)
-    {
-        case IDC_BTN_SQRT:
-            if (x < 0) error = 1;
-            else result = sqrt(x);
-            break;
-        case IDC_BTN_X2:
-            result = x * x;
-            break;
-        case IDC_BTN_1X:
-            if (x == 0) error = 1;
-            else result = 1.0 / x;
-            break;
-        case IDC_BTN_SIN:
-            result = sin(degree_mode ? to_rad(x) : x);
-            break;
-        case IDC_BTN_COS:
-            result = cos(degree_mode ? to_rad(x) : x);
-            break;
-        case IDC_BTN_TAN:
-            result = tan(degree_mode ? to_rad(x) : x);
-            break;
-        case IDC_BTN_LN:
-            if (x <= 0) error = 1;
-            else result = log(x);
-            break;
-        case IDC_BTN_LOG:
-            if (x <= 0) error = 1;
-            else result = log10(x);
-            break;
-        case IDC_BTN_EXP:
-            result = exp(x);
-            break;
-        case IDC_BTN_ABS:
-            result = fabs(x);
-            break;
-        case IDC_BTN_PI:
-            result = PI;
-            break;
-        case IDC_BTN_EE:
-            result = 2.718281828459045;
-            break;
-        case IDC_BTN_INV:
-            /* sin^-1, cos^-1, tan^-1 - simplified: atan(x) */
-            if (x < -1 || x > 1) error = 1;
-            else result = degree_mode ? (asin(x) * 180.0 / PI) : asin(x);
-            break;
-        default:
-            break;
-    }
-
-    if (error)
+    if (keypad_unary(&s_keypad, unary_func(op_id)) != 0)
     {
         MessageBoxA(hwnd, "Invalid input.", "Error", MB_OK | MB_ICONERROR);
         return;
     }
-    set_display_value(result);
-    pending_op = 0;
-    expression[0] = '\0';
-    {
-        char hist[MAX_HIST_LINE];
-        const char *fn = unary_func_name(op_id);
-        if (op_id == IDC_BTN_PI || op_id == IDC_BTN_EE)
-            snprintf(hist, sizeof(hist), "%s = %.12g", fn, result);
-        else
-            snprintf(hist, sizeof(hist), "%s(%.10g) = %.12g", fn, x, result);
-        add_history(hist);
-    }
-    update_display(hwnd);
-    update_expression(hwnd);
-    update_feedback(hwnd);
+    update_all(hwnd);
 }
 
 static void on_digit(HWND hwnd, int digit)
 {
-    char c = (char)('0' + digit);
-    append_digit(hwnd, c);
+    keypad_digit(&s_keypad, digit);
+    update_display(hwnd);
 }
 
 static void on_operator(HWND hwnd, char op)
@@ -377,15 +159,8 @@ static void on_operator(HWND hwnd, char op)
 
 static void on_clear(HWND hwnd)
 {
-    strcpy(display, "0");
-    expression[0] = '\0';
-    last_result[0] = '\0';
-    fresh_display = 1;
-    pending_op = 0;
-    operand1 = 0;
-    update_display(hwnd);
-    update_expression(hwnd);
-    update_feedback(hwnd);
+    keypad_clear(&s_keypad);
+    update_all(hwnd);
 }
 
 static LRESULT CALLBACK HistoryDlgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
@@ -437,9 +212,9 @@ static void show_history(HWND hwndParent)
         dlgW/2 - 40, dlgH - 50, 80, 28, hDlg, (HMENU)2, GetModuleHandle(NULL), NULL);
 
     HWND hList = GetDlgItem(hDlg, 1);
-    for (int i = s_history_count - 1; i >= 0; i--)
-        SendMessageA(hList, LB_ADDSTRING, 0, (LPARAM)s_history[i]);
-    if (s_history_count == 0)
+    for (int i = s_keypad.history_count - 1; i >= 0; i--)
+        SendMessageA(hList, LB_ADDSTRING, 0, (LPARAM)s_keypad.history[i]);
+    if (s_keypad.history_count == 0)
         SendMessageA(hList, LB_ADDSTRING, 0, (LPARAM)"(No calculations yet)");
 
     RECT wr;
@@ -460,17 +235,7 @@ static void show_history(HWND hwndParent)
 
 static void on_backspace(HWND hwnd)
 {
-    if (fresh_display) return;
-    size_t len = strlen(display);
-    if (len <= 1)
-    {
-        strcpy(display, "0");
-        fresh_display = 1;
-    }
-    else
-    {
-        display[len - 1] = '\0';
-    }
+    keypad_backspace(&s_keypad);
     update_display(hwnd);
 }
 
@@ -594,7 +359,6 @@ static LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lPara
                                        0, 0, 100, 44, hwnd, (HMENU)(INT_PTR)IDC_DISPLAY,
                                        GetModuleHandle(NULL), NULL);
 
-            last_result[0] = '\0';
             hFeedback = CreateWindowExA(0, "STATIC", "",
                                         WS_CHILD | WS_VISIBLE | SS_RIGHT,
                                         0, 0, 100, 20, hwnd, (HMENU)(INT_PTR)IDC_FEEDBACK,
@@ -863,6 +627,8 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     if (!RegisterClassExA(&wc))
         return 1;
 
+    keypad_init(&s_keypad);
+
     HWND hwnd = CreateWindowExA(0, "CalculatorGUI", "Scientific Calculator",
                                 WS_OVERLAPPEDWINDOW,
                                 CW_USEDEFAULT, CW_USEDEFAULT, 320, 520,
@@ -1,121 +1,1538 @@
 /*
  * Full Calculator - Basic to Scientific
- * Build: gcc Calcultor.c -o Calcultor -lm
- * Operations: + - * / % ^ sqrt sin cos tan asin acos atan sinh cosh tanh log ln exp abs fact
+ * Build: gcc Calcultor.c calc.c calc_expr.c calc_prog.c calc_solve.c calc_quad.c calc_rand.c calc_rat.c
+ *        calc_sketch.c calc_pipe.c calc_poly.c -o Calcultor -lm
+ *        (add -O2 -fopenmp to run integrate/sum/montecarlo/quantile on all cores)
+ * Operations: + - * / % ^ < <= > >= == != sqrt sin cos tan asin acos atan sinh cosh tanh log ln exp abs fact
+ * Complex mode: "0 complex 1" on, "0 complex 0" off; operands may be written as 1+2i, -i, 3.5
+ *         or a variable, and formulas may use i, e.g. sqrt(-4) + 2i*x. Variables stay real.
+ * Variables: "x = 5" assigns, any operand may name a variable; "ans" holds the last result
+ * Settings: "0 deg 1" degrees, "0 deg 0" radians, "0 prec 12" significant digits
+ * Diff mode: "0 diff 1" also prints d/da and d/db of each a op b result, and the
+ *         derivative of a formula along each variable it reads, up to 4 (dual numbers)
+ * Formulas: any other line is parsed as infix, e.g. "r = 2" then "pi * r^2 + sqrt(2)"
+ * Solve: "solve 0 2 x^2 - 2" finds x in [0, 2] where the formula is zero
+ * Calculus: "integrate sin(x) 0 pi" (in x), "sum 1/k^2 k=1..1000000"
+ * Random: rand() uniform (0,1), randn() standard normal; "0 seed 42" reseeds;
+ *         "montecarlo 1e6 4*sqrt(1 - rand()^2)" estimates pi as a mean with its variance
+ * Rational mode: "0 rational 1" keeps + - * / exact, e.g. 1/3 + 1/6 => 1/2
+ * Sketches: "quantile 0.5,0.99 data.txt", "distinct data.csv@2" (field 2 only);
+ *         "sketch part.sketch data.txt" saves a mergeable summary usable as a source
+ * Scripts: "Calcultor -f script.calc" prints each formula line's value, one per line;
+ *         the compiled script is cached next to it in script.calc.cache
+ * Pipelines: "Calcultor -p 'map x*1.2 | filter x > 0 | reduce +' data.txt@2" (stdin if no file)
+ * Polynomials, highest power first: "roots 1 0 -2" (all complex roots), "deriv 1 0 -2",
+ *         "polymul 1 1 * 1 -1", "polyval 1 0 -2 data.txt@2" (value at each number)
  */
 
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L   /* mkstemp() for the script cache */
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <time.h>
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include <math.h>
+#include <stddef.h>
+#include <complex.h>
+#include "calc.h"
 
-#define PI 3.14159265358979323846
-#define E  2.71828182845904523536
-#define MAX_OP 16
+#define MAX_LINE    1024
+#define ARENA_SIZE  (64 * 1024)
 
-static double fact(double n)
+/* Parses "3", "-2.5", "4i", "-i", "1+2i", "1.5e3-0.5i". Returns 0 on success. */
+static int parse_complex(const char *s, double complex *z)
 {
-    if (n < 0 || n != floor(n))
-        return -1;  /* invalid */
-    if (n <= 1)
-        return 1;
-    double r = 1;
-    for (long i = 2; i <= (long)n; i++)
-        r *= i;
-    return r;
-}
-
-static void to_lower(char *s)
-{
-    for (; *s; s++)
-        if (*s >= 'A' && *s <= 'Z')
-            *s += 32;
-}
-
-static int is_unary(const char *op)
-{
-    return strcmp(op, "sqrt") == 0 || strcmp(op, "sin") == 0 || strcmp(op, "cos") == 0 ||
-           strcmp(op, "tan") == 0 || strcmp(op, "asin") == 0 || strcmp(op, "acos") == 0 ||
-           strcmp(op, "atan") == 0 || strcmp(op, "sinh") == 0 || strcmp(op, "cosh") == 0 ||
-           strcmp(op, "tanh") == 0 || strcmp(op, "log") == 0 || strcmp(op, "ln") == 0 ||
-           strcmp(op, "exp") == 0 || strcmp(op, "abs") == 0 || strcmp(op, "fact") == 0 ||
-           strcmp(op, "floor") == 0 || strcmp(op, "ceil") == 0 || strcmp(op, "inv") == 0 ||
-           strcmp(op, "neg") == 0 || strcmp(op, "pi") == 0 || strcmp(op, "e") == 0;
-}
-
-static int compute(double a, double b, const char *op, double *result)
-{
-    char opbuf[MAX_OP];
-    strncpy(opbuf, op, MAX_OP - 1);
-    opbuf[MAX_OP - 1] = '\0';
-    to_lower(opbuf);
-
-    if (strcmp(opbuf, "+") == 0)        { *result = a + b; return 0; }
-    if (strcmp(opbuf, "-") == 0)        { *result = a - b; return 0; }
-    if (strcmp(opbuf, "*") == 0)        { *result = a * b; return 0; }
-    if (strcmp(opbuf, "/") == 0)        { if (b == 0) return -1; *result = a / b; return 0; }
-    if (strcmp(opbuf, "%") == 0)        { if ((long)b == 0) return -1; *result = (double)((long)a % (long)b); return 0; }
-    if (strcmp(opbuf, "^") == 0)        { *result = pow(a, b); return 0; }
-    if (strcmp(opbuf, "pow") == 0)      { *result = pow(a, b); return 0; }
-    if (strcmp(opbuf, "p") == 0)        { *result = (a / 100.0) * b; return 0; }
-    if (strcmp(opbuf, "//") == 0)       { if ((long)b == 0) return -1; *result = floor(a / b); return 0; }
-
-    /* Unary operations (use 'a', ignore b) */
-    if (strcmp(opbuf, "sqrt") == 0)     { if (a < 0) return -2; *result = sqrt(a); return 0; }
-    if (strcmp(opbuf, "sin") == 0)      { *result = sin(a); return 0; }
-    if (strcmp(opbuf, "cos") == 0)      { *result = cos(a); return 0; }
-    if (strcmp(opbuf, "tan") == 0)      { *result = tan(a); return 0; }
-    if (strcmp(opbuf, "asin") == 0)     { if (a < -1 || a > 1) return -2; *result = asin(a); return 0; }
-    if (strcmp(opbuf, "acos") == 0)     { if (a < -1 || a > 1) return -2; *result = acos(a); return 0; }
-    if (strcmp(opbuf, "atan") == 0)     { *result = atan(a); return 0; }
-    if (strcmp(opbuf, "sinh") == 0)     { *result = sinh(a); return 0; }
-    if (strcmp(opbuf, "cosh") == 0)     { *result = cosh(a); return 0; }
-    if (strcmp(opbuf, "tanh") == 0)     { *result = tanh(a); return 0; }
-    if (strcmp(opbuf, "log") == 0)      { if (a <= 0) return -2; *result = log10(a); return 0; }
-    if (strcmp(opbuf, "ln") == 0)       { if (a <= 0) return -2; *result = log(a); return 0; }
-    if (strcmp(opbuf, "exp") == 0)      { *result = exp(a); return 0; }
-    if (strcmp(opbuf, "abs") == 0)      { *result = fabs(a); return 0; }
-    if (strcmp(opbuf, "fact") == 0)     { *result = fact(a); return (*result < 0) ? -2 : 0; }
-    if (strcmp(opbuf, "floor") == 0)    { *result = floor(a); return 0; }
-    if (strcmp(opbuf, "ceil") == 0)     { *result = ceil(a); return 0; }
-    if (strcmp(opbuf, "inv") == 0)      { if (a == 0) return -1; *result = 1.0 / a; return 0; }
-    if (strcmp(opbuf, "neg") == 0)      { *result = -a; return 0; }
-    if (strcmp(opbuf, "pi") == 0)       { *result = PI; return 0; }
-    if (strcmp(opbuf, "e") == 0)        { *result = E; return 0; }
-
-    return 1;  /* unknown */
-}
-
-int main(void)
-{
-    char op[MAX_OP];
+    char *end;
+    double re = 0, im = 0;
+
+    if ((s[0] == 'i' || s[0] == 'I') && s[1] == '\0') { *z = I; return 0; }
+    if ((s[0] == '+' || s[0] == '-') && (s[1] == 'i' || s[1] == 'I') && s[2] == '\0')
+    {
+        *z = (s[0] == '-') ? -I : I;
+        return 0;
+    }
+
+    re = strtod(s, &end);
+    if (end == s)
+        return -1;
+    if (*end == '\0') { *z = re; return 0; }
+    if ((*end == 'i' || *end == 'I') && end[1] == '\0') { *z = re * I; return 0; }
+
+    /* Real part followed by a signed imaginary part */
+    if (*end != '+' && *end != '-')
+        return -1;
+    const char *p = end;
+    if ((p[1] == 'i' || p[1] == 'I') && p[2] == '\0')
+        im = (*p == '-') ? -1 : 1;
+    else
+    {
+        im = strtod(p, &end);
+        if (end == p || (*end != 'i' && *end != 'I') || end[1] != '\0')
+            return -1;
+    }
+    *z = re + im * I;
+    return 0;
+}
+
+/* Complex literal or the name of a (real) context variable */
+static int parse_complex_operand(const calc_ctx *ctx, const char *s, double complex *z)
+{
+    double v;
+    if (parse_complex(s, z) == 0)
+        return 0;
+    if (calc_get_var(ctx, s, &v) != 0)
+        return -1;
+    *z = v;
+    return 0;
+}
+
+/* Operand is either a literal number or the name of a context variable */
+static int parse_operand(const calc_ctx *ctx, const char *s, double *v)
+{
+    char *end;
+    *v = strtod(s, &end);
+    if (end != s && *end == '\0')
+        return 0;
+    return calc_get_var(ctx, s, v);
+}
+
+/* Exact literal ("0.1", "7/8") or a variable converted from its double value */
+static int parse_rat_operand(const calc_ctx *ctx, const char *s, calc_rat *r)
+{
+    double v;
+    if (calc_rat_parse(s, r) == 0)
+        return 0;
+    if (calc_get_var(ctx, s, &v) != 0)
+        return -1;
+    calc_rat_from_double(r, v);
+    return 0;
+}
+
+static void print_rat(calc_ctx *ctx, const calc_rat *r)
+{
+    char out[160];
+    calc_set_var(ctx, "ans", calc_rat_value(r));
+    calc_rat_format(ctx, r, out, sizeof(out));
+    printf("  => %s\n\n", out);
+}
+
+static void format_complex(const calc_ctx *ctx, double complex z, char *out, size_t size)
+{
+    double re = creal(z), im = cimag(z);
+    char sre[64], sim[64];
+    if (re == 0) re = 0;  /* avoid printing -0 */
+    calc_format(ctx, re, sre, sizeof(sre));
+    calc_format(ctx, fabs(im), sim, sizeof(sim));
+    if (im == 0)
+        snprintf(out, size, "%s", sre);
+    else if (re == 0)
+        snprintf(out, size, "%s%si", im < 0 ? "-" : "", sim);
+    else
+        snprintf(out, size, "%s %c %si", sre, im < 0 ? '-' : '+', sim);
+}
+
+static void print_complex(const calc_ctx *ctx, double complex z)
+{
+    char out[160];
+    format_complex(ctx, z, out, sizeof(out));
+    printf("  => %s\n\n", out);
+}
+
+static void print_error(int err, const char *op)
+{
+    if (err == -1)
+        printf("  => Error: Division by zero.\n\n");
+    else if (err == -2)
+        printf("  => Error: Invalid input (domain error).\n\n");
+    else if (*op == '\0')  /* a parsed formula only fails this way on complex-only operators */
+        printf("  => Error: Imaginary numbers and conj/re/im/arg need complex mode (0 complex 1).\n\n");
+    else
+        printf("  => Error: Unknown operator '%s'.\n\n", op);
+}
+
+static void print_result(calc_ctx *ctx, double result)
+{
+    char out[64];
+    calc_set_var(ctx, "ans", result);
+    calc_format(ctx, result, out, sizeof(out));
+    printf("  => %s\n\n", out);
+}
+
+/*
+ * Classic "a op b" line. Returns -1 without printing anything when an operand
+ * is not a number or variable, so the line can be retried as an expression.
+ */
+static int run_pair(calc_ctx *ctx, const char *sa, const char *op, const char *sb,
+                    int complex_mode, int diff_mode, int rational_mode)
+{
+    int err;
+
+    if (complex_mode)
+    {
+        double complex za, zb, zr;
+        if (parse_complex_operand(ctx, sa, &za) != 0 || parse_complex_operand(ctx, sb, &zb) != 0)
+            return -1;
+        err = calc_compute_complex(ctx, za, zb, op, &zr);
+        if (err != 0)
+            print_error(err, op);
+        else
+        {
+            if (cimag(zr) == 0)
+                calc_set_var(ctx, "ans", creal(zr));
+            print_complex(ctx, zr);
+        }
+        return 0;
+    }
+
+    if (rational_mode)
+    {
+        calc_rat ra, rb, rr;
+        if (parse_rat_operand(ctx, sa, &ra) != 0 || parse_rat_operand(ctx, sb, &rb) != 0)
+            return -1;
+        err = calc_compute_rat(ctx, &ra, &rb, calc_op_lookup(op), &rr);
+        if (err != 0)
+            print_error(err, op);
+        else
+            print_rat(ctx, &rr);
+        return 0;
+    }
+
     double a, b, result;
+    if (parse_operand(ctx, sa, &a) != 0 || parse_operand(ctx, sb, &b) != 0)
+        return -1;
+
+    if (diff_mode)
+    {
+        /* Seed direction 0 with d/da and direction 1 with d/db */
+        calc_dual da = { a, { 1, 0 } }, db = { b, { 0, 1 } }, dr;
+        err = calc_compute_dual(ctx, &da, &db, op, &dr);
+        if (err != 0)
+            print_error(err, op);
+        else
+        {
+            char out[64], ga[64], gb[64];
+            calc_set_var(ctx, "ans", dr.v);
+            calc_format(ctx, dr.v, out, sizeof(out));
+            calc_format(ctx, dr.d[0], ga, sizeof(ga));
+            calc_format(ctx, dr.d[1], gb, sizeof(gb));
+            printf("  => %s   d/da = %s   d/db = %s\n\n", out, ga, gb);
+        }
+        return 0;
+    }
+
+    err = calc_compute(ctx, a, b, op, &result);
+    if (err != 0)
+        print_error(err, op);
+    else
+        print_result(ctx, result);
+    return 0;
+}
+
+static int report_parse_error(int err, size_t pos)
+{
+    if (err == 1)
+        printf("  => Error: Unknown function at column %zu.\n\n", pos + 1);
+    else if (err == 3)
+        printf("  => Error: Unknown variable at column %zu.\n\n", pos + 1);
+    else if (err == 4)
+        printf("  => Error: Expression too large.\n\n");
+    else if (err != 0)
+        printf("  => Error: Syntax error at column %zu.\n\n", pos + 1);
+    return err;
+}
+
+/*
+ * Real formulas seen before skip the parser: the last FORMULA_CACHE distinct
+ * texts keep their trees in the cache's own arena as calc_formulas, so a line
+ * fed to the CLI over and over (a shell loop that changes x between runs, say)
+ * is compiled once it has been evaluated CALC_HOT_CALLS times. A new variable
+ * can change what a name means (e, pi and i are constants only until
+ * assigned), so the cache is dropped whenever the variable count changes.
+ */
+#define FORMULA_CACHE  16
+
+typedef struct formula_cache
+{
+    int count, var_count;
+    char text[FORMULA_CACHE][MAX_LINE];
+    calc_formula f[FORMULA_CACHE];
+    calc_arena arena;
+    char buf[ARENA_SIZE];
+} formula_cache;
+
+static formula_cache cache;
+
+static void cache_clear(const calc_ctx *ctx)
+{
+    cache.count = 0;
+    cache.var_count = ctx->var_count;
+    calc_arena_init(&cache.arena, cache.buf, sizeof(cache.buf));
+}
+
+/* Finds text in the cache or parses it into a new entry; reports parse errors */
+static int cache_formula(const calc_ctx *ctx, const char *text, calc_formula **out)
+{
+    calc_node *root;
+    size_t pos = 0;
+
+    if (ctx->var_count != cache.var_count)
+        cache_clear(ctx);
+    for (int i = 0; i < cache.count; i++)
+        if (strcmp(cache.text[i], text) == 0)
+        {
+            *out = &cache.f[i];
+            return 0;
+        }
+
+    if (cache.count == FORMULA_CACHE)
+        cache_clear(ctx);
+    int err = calc_parse(ctx, &cache.arena, text, &root, &pos);
+    if (err == 4 && cache.count > 0)
+    {
+        cache_clear(ctx);  /* the arena is full of older trees */
+        err = calc_parse(ctx, &cache.arena, text, &root, &pos);
+    }
+    if (report_parse_error(err, pos) != 0)
+        return err;
+    snprintf(cache.text[cache.count], MAX_LINE, "%s", text);
+    calc_formula_init(&cache.f[cache.count], root);
+    *out = &cache.f[cache.count++];
+    return 0;
+}
+
+/* Parses (or finds) and evaluates an infix formula */
+static int run_expression(calc_ctx *ctx, const char *text, double *result)
+{
+    calc_formula *f = NULL;
+    int err = cache_formula(ctx, text, &f);
+
+    if (err != 0)
+        return err;
+    err = calc_formula_eval(ctx, f, result);
+    ctx->rng_counter++;  /* next line draws fresh rand() values */
+    if (err != 0)
+        print_error(err, "");
+    return err;
+}
+
+/* Complex-mode formula: like run_expression(), with complex arithmetic throughout */
+static int run_expression_complex(calc_ctx *ctx, calc_arena *arena, const char *text, double complex *result)
+{
+    calc_node *root;
+    size_t pos = 0;
+
+    calc_arena_reset(arena);
+    int err = calc_parse(ctx, arena, text, &root, &pos);
+    if (report_parse_error(err, pos) != 0)
+        return err;
+    err = calc_eval_complex(ctx, root, result);
+    ctx->rng_counter++;
+    if (err != 0)
+        print_error(err, "");
+    return err;
+}
+
+/* Diff-mode formula: the value and its derivative along each variable the formula reads */
+static void run_expression_dual(calc_ctx *ctx, calc_arena *arena, const char *text)
+{
+    calc_node *root;
+    calc_prog prog;
+    calc_dual r;
+    int vars[CALC_DUAL_N];
+    size_t pos = 0;
+
+    calc_arena_reset(arena);
+    int err = calc_parse(ctx, arena, text, &root, &pos);
+    if (report_parse_error(err, pos) != 0)
+        return;
+    if (calc_compile(root, &prog) != 0)
+    {
+        printf("  => Error: Expression too large.\n\n");
+        return;
+    }
+    int n = calc_prog_vars(&prog, vars, CALC_DUAL_N);
+    int seeded = (n < CALC_DUAL_N) ? n : CALC_DUAL_N;
+    err = calc_run_grad(ctx, &prog, vars, seeded, &r);
+    ctx->rng_counter++;
+    if (err != 0)
+    {
+        print_error(err, "");
+        return;
+    }
+
+    char out[64];
+    calc_set_var(ctx, "ans", r.v);
+    calc_format(ctx, r.v, out, sizeof(out));
+    printf("  => %s", out);
+    for (int k = 0; k < seeded; k++)
+    {
+        calc_format(ctx, r.d[k], out, sizeof(out));
+        printf("   d/d%s = %s", ctx->var_names[vars[k]], out);
+    }
+    if (n == 0)
+        printf("   (no variables to differentiate)");
+    else if (n > seeded)
+        printf("   (first %d of %d variables)", seeded, n);
+    printf("\n\n");
+}
+
+/* Rational-mode formula: literals are taken as the decimals they were typed as */
+static void run_expression_rat(calc_ctx *ctx, calc_arena *arena, const char *text)
+{
+    calc_node *root;
+    calc_rat r;
+    size_t pos = 0;
+
+    calc_arena_reset(arena);
+    int err = calc_parse(ctx, arena, text, &root, &pos);
+    if (report_parse_error(err, pos) != 0)
+        return;
+    err = calc_eval_rat(ctx, root, &r);
+    ctx->rng_counter++;
+    if (err != 0)
+        print_error(err, "");
+    else
+        print_rat(ctx, &r);
+}
+
+/* Parses text as a formula in variable name (created if needed) and compiles it */
+static int compile_in(calc_ctx *ctx, calc_arena *arena, const char *line, const char *text,
+                      const char *name, calc_prog *prog, int *var)
+{
+    calc_node *tree;
+    size_t pos = 0;
+
+    if (calc_var_index(ctx, name) < 0 && calc_set_var(ctx, name, 0) != 0)
+    {
+        printf("  => Error: Too many variables.\n\n");
+        return -1;
+    }
+    *var = calc_var_index(ctx, name);
+
+    calc_arena_reset(arena);
+    int err = calc_parse(ctx, arena, text, &tree, &pos);
+    if (report_parse_error(err, (size_t)(text - line) + pos) != 0)
+        return err;
+    if (calc_compile(tree, prog) != 0)
+    {
+        printf("  => Error: Expression too large.\n\n");
+        return 4;
+    }
+    return 0;
+}
+
+/* Cuts the last whitespace-separated word off s and returns it, or NULL */
+static char *pop_word(char *s)
+{
+    char *end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1]))
+        *--end = '\0';
+    char *w = end;
+    while (w > s && !isspace((unsigned char)w[-1]))
+        w--;
+    if (w == end || w == s)
+        return NULL;
+    w[-1] = '\0';
+    return w;
+}
+
+/* "integrate formula a b": definite integral in x; bounds may be formulas such as pi/2 */
+static void run_integrate(calc_ctx *ctx, calc_arena *arena, char *line)
+{
+    char *text = strstr(line, "integrate") + 9;
+    char *sb = pop_word(text), *sa = sb ? pop_word(text) : NULL;
+    double a, b, result, abserr;
+    calc_prog prog;
+    int var;
+
+    if (!sa)
+    {
+        printf("  => Usage: integrate formula-in-x a b\n\n");
+        return;
+    }
+    if (run_expression(ctx, sa, &a) != 0 || run_expression(ctx, sb, &b) != 0)
+        return;
+    if (compile_in(ctx, arena, line, text, "x", &prog, &var) != 0)
+        return;
+
+    int err = calc_integrate(ctx, &prog, var, a, b, 1e-10, &result, &abserr);
+    if (err < 0)
+        print_error(err, "");
+    else
+    {
+        char out[64], est[64];
+        calc_set_var(ctx, "ans", result);
+        calc_format(ctx, result, out, sizeof(out));
+        snprintf(est, sizeof(est), "%.2g", abserr);
+        printf("  => %s   (error estimate %s%s)\n\n", out, est, err == 5 ? ", did not converge" : "");
+    }
+}
+
+/* "sum formula k=lo..hi": compensated sum of the formula over integer k */
+static void run_sum(calc_ctx *ctx, calc_arena *arena, char *line)
+{
+    char *text = strstr(line, "sum") + 3;
+    char *range = pop_word(text), *eq, name[CALC_MAX_NAME];
+    long long lo, hi, bad = 0;
+    double result;
+    calc_prog prog;
+    int var, n = 0;
+
+    eq = range ? strchr(range, '=') : NULL;
+    if (!eq || eq == range || eq - range >= CALC_MAX_NAME ||
+        sscanf(eq + 1, "%lld..%lld%n", &lo, &hi, &n) != 2 || eq[1 + n] != '\0')
+    {
+        printf("  => Usage: sum formula k=lo..hi\n\n");
+        return;
+    }
+    memcpy(name, range, eq - range);
+    name[eq - range] = '\0';
+    if (compile_in(ctx, arena, line, text, name, &prog, &var) != 0)
+        return;
+
+    int err = calc_sum(ctx, &prog, var, lo, hi, &result, &bad);
+    if (err == 4)
+        printf("  => Error: Range too large (at most %llu terms).\n\n", (unsigned long long)CALC_SUM_MAX);
+    else if (err == -1 || err == -2)
+        printf("  => Error: %s at %s = %lld.\n\n", err == -1 ? "Division by zero" : "Invalid input (domain error)",
+               name, bad);
+    else if (err != 0)
+        print_error(err, "");
+    else
+        print_result(ctx, result);
+}
+
+/* "montecarlo N formula": mean and variance of the formula over N random samples */
+static void run_montecarlo(calc_ctx *ctx, calc_arena *arena, const char *line)
+{
+    const char *args = strstr(line, "montecarlo") + 10;
+    double count, mean, variance;
+    calc_prog prog;
+    calc_node *tree;
+    size_t pos = 0;
+    int off = 0;
+
+    if (sscanf(args, "%lf %n", &count, &off) != 1 || args[off] == '\0' || count < 1 || count > 9e18)
+    {
+        printf("  => Usage: montecarlo N formula\n\n");
+        return;
+    }
+    calc_arena_reset(arena);
+    int err = calc_parse(ctx, arena, args + off, &tree, &pos);
+    if (report_parse_error(err, (size_t)(args - line) + off + pos) != 0)
+        return;
+    if (calc_compile(tree, &prog) != 0)
+    {
+        printf("  => Error: Expression too large.\n\n");
+        return;
+    }
+
+    long long n = (long long)count;
+    err = calc_montecarlo(ctx, &prog, n, &mean, &variance);
+    ctx->rng_counter += (unsigned long long)n;
+    if (err != 0)
+    {
+        print_error(err, "");
+        return;
+    }
+    char sm[64], sv[64], se[64];
+    calc_set_var(ctx, "ans", mean);
+    calc_format(ctx, mean, sm, sizeof(sm));
+    calc_format(ctx, variance, sv, sizeof(sv));
+    snprintf(se, sizeof(se), "%.3g", sqrt(variance / n));
+    printf("  => mean %s   variance %s   std error %s\n\n", sm, sv, se);
+}
+
+/* "solve lo hi formula": root of formula(x) in [lo, hi] */
+static void run_solve(calc_ctx *ctx, calc_arena *arena, const char *line)
+{
+    const char *args = strstr(line, "solve") + 5;
+    double lo, hi, root;
+    int off = 0;
+    calc_node *tree;
+    calc_prog prog;
+    size_t pos = 0;
+
+    if (sscanf(args, "%lf %lf %n", &lo, &hi, &off) != 2 || args[off] == '\0')
+    {
+        printf("  => Usage: solve lo hi formula-in-x\n\n");
+        return;
+    }
+    if (calc_var_index(ctx, "x") < 0 && calc_set_var(ctx, "x", 0) != 0)
+    {
+        printf("  => Error: Too many variables.\n\n");
+        return;
+    }
+
+    calc_arena_reset(arena);
+    int err = calc_parse(ctx, arena, args + off, &tree, &pos);
+    if (report_parse_error(err, (size_t)(args - line) + off + pos) != 0)
+        return;
+    if (calc_compile(tree, &prog) != 0)
+    {
+        printf("  => Error: Expression too large.\n\n");
+        return;
+    }
+    err = calc_solve(ctx, &prog, calc_var_index(ctx, "x"), lo, hi, &root);
+    if (err == 6)
+        printf("  => Error: No sign change of f(x) between %g and %g.\n\n", lo, hi);
+    else if (err == 5)
+        printf("  => Error: No root found; the solver did not converge.\n\n");
+    else if (err != 0)
+        print_error(err, "");
+    else
+    {
+        char out[64];
+        calc_set_var(ctx, "ans", root);
+        calc_format(ctx, root, out, sizeof(out));
+        printf("  => x = %s\n\n", out);
+    }
+}
+
+#define NUMBER_CHUNK  65536   /* values parsed before each hand-off to a sink */
+#define SEPARATORS    " \t,;\r\n"
+
+typedef void (*number_sink)(void *arg, const double *x, size_t n);
+
+/* Feeds every number in the file (or only field col, counted from 1) to sink; other text is skipped */
+static void read_numbers(FILE *f, int col, number_sink sink, void *arg)
+{
+    static char text[64 * 1024];
+    static double chunk[NUMBER_CHUNK];
+    size_t n = 0;
+
+    while (fgets(text, sizeof(text), f))
+    {
+        int field = 0;
+        /* Not strtok: callers may be in the middle of a strtok loop of their own */
+        for (char *tok = text; *(tok += strspn(tok, SEPARATORS)) != '\0'; )
+        {
+            char *end, *stop = tok + strcspn(tok, SEPARATORS);
+            char *next = (*stop != '\0') ? stop + 1 : stop;
+            *stop = '\0';
+            if (col == 0 || ++field == col)
+            {
+                double v = strtod(tok, &end);
+                if (end != tok && *end == '\0')
+                    chunk[n++] = v;
+            }
+            tok = next;
+            if (n == NUMBER_CHUNK)
+            {
+                sink(arg, chunk, n);
+                n = 0;
+            }
+        }
+    }
+    if (n > 0)
+        sink(arg, chunk, n);
+}
+
+/* Opens "data.csv" or "data.csv@3"; *col gets the field number, 0 for all fields */
+static FILE *open_source(char *src, int *col)
+{
+    char *at = strrchr(src, '@');
+    *col = 0;
+    if (at && at[1] != '\0' && strspn(at + 1, "0123456789") == strlen(at + 1))
+    {
+        *col = atoi(at + 1);
+        *at = '\0';
+    }
+    return fopen(src, "rb");
+}
+
+static void sketch_sink(void *arg, const double *x, size_t n)
+{
+    calc_sketch_add_column(arg, x, n);
+}
+
+/*
+ * Merges each source into s. A source is a file saved by "sketch" or a text
+ * file of numbers; "data.csv@3" reads only the third field of each line.
+ */
+static int sketch_sources(calc_sketch *s, char *args)
+{
+    static calc_sketch part;
+    static unsigned char saved[CALC_SKETCH_BYTES + 1];
+    int count = 0;
+
+    calc_sketch_init(s);
+    for (char *src = strtok(args, " \t"); src; src = strtok(NULL, " \t"))
+    {
+        int col;
+        FILE *f = open_source(src, &col);
+        if (!f)
+        {
+            printf("  => Error: Cannot open '%s'.\n\n", src);
+            return -1;
+        }
+        size_t len = fread(saved, 1, sizeof(saved), f);
+        if (len >= 3 && memcmp(saved, "CSK", 3) == 0)
+        {
+            if (calc_sketch_load(&part, saved, len) != 0)
+            {
+                printf("  => Error: '%s' is not a valid sketch file.\n\n", src);
+                fclose(f);
+                return -1;
+            }
+            calc_sketch_merge(s, &part);
+        }
+        else
+        {
+            rewind(f);
+            read_numbers(f, col, sketch_sink, s);
+        }
+        fclose(f);
+        count++;
+    }
+    return (count > 0) ? 0 : -1;
+}
+
+/*
+ * "quantile 0.5,0.95,0.99 sources...", "distinct sources..." and
+ * "sketch out.sketch sources..." (saves the merged sketch for later runs)
+ */
+static void run_sketch(calc_ctx *ctx, const char *cmd, char *line)
+{
+    static calc_sketch s;
+    char *first = strstr(line, cmd) + strlen(cmd);
+    char *sources = first;
+
+    first += strspn(first, " \t");
+    if (*cmd != 'd')
+    {
+        size_t len = strcspn(first, " \t");
+        sources = first + len + (first[len] != '\0');
+        first[len] = '\0';
+    }
+    if (sources[strspn(sources, " \t")] == '\0')
+    {
+        printf("  => Usage: quantile q[,q...] files..., distinct files..., sketch out files...\n\n");
+        return;
+    }
+    if (sketch_sources(&s, sources) != 0)
+        return;
+
+    if (*cmd == 'd')
+    {
+        double est = calc_sketch_distinct(&s);
+        calc_set_var(ctx, "ans", floor(est + 0.5));
+        printf("  => ~%.0f distinct of %.0f values\n\n", est, s.count);
+        return;
+    }
+
+    if (*cmd == 's')
+    {
+        static unsigned char out[CALC_SKETCH_BYTES];
+        size_t len = calc_sketch_save(&s, out, sizeof(out));
+        FILE *f = fopen(first, "wb");
+        if (!f || fwrite(out, 1, len, f) != len)
+            printf("  => Error: Cannot write '%s'.\n\n", first);
+        else
+            printf("  => Saved sketch of %.0f values to %s (%zu bytes)\n\n", s.count, first, len);
+        if (f)
+            fclose(f);
+        return;
+    }
+
+    const char *sep = " ";
+    printf("  =>");
+    for (char *qs = strtok(first, ","); qs; qs = strtok(NULL, ","), sep = "   ")
+    {
+        char out[64];
+        double q = atof(qs), v;
+        if (calc_sketch_quantile(&s, q, &v) != 0)
+        {
+            printf("%sp%g (out of range)", sep, q * 100);
+            continue;
+        }
+        calc_set_var(ctx, "ans", v);
+        calc_format(ctx, v, out, sizeof(out));
+        printf("%sp%g = %s", sep, q * 100, out);
+    }
+    printf("   (%.0f values)\n\n", s.count);
+}
+
+/*
+ * Polynomials are typed highest power first: "1 0 -2" is x^2 - 2.
+ * "roots 1 0 -2", "deriv 1 0 -2", "polymul 1 1 * 1 -1" and
+ * "polyval 1 0 -2 sources..." (the value at every number of the sources).
+ */
+static int parse_poly(char **text, calc_poly *p)
+{
+    double c[CALC_POLY_MAX_DEGREE + 1];
+    char *s = *text, *end;
+    int n = 0;
+
+    for (;;)
+    {
+        s += strspn(s, " \t");
+        double v = strtod(s, &end);
+        if (end == s || (*end != '\0' && !isspace((unsigned char)*end)))
+            break;
+        if (n > CALC_POLY_MAX_DEGREE)
+            return 4;
+        c[n++] = v;
+        s = end;
+    }
+    *text = s;
+    if (n == 0)
+        return 2;
+    for (int i = 0; i < n / 2; i++)
+    {
+        double t = c[i];
+        c[i] = c[n - 1 - i];
+        c[n - 1 - i] = t;
+    }
+    return calc_poly_set(p, c, n);
+}
+
+static void print_poly(const calc_ctx *ctx, const calc_poly *p)
+{
+    printf("  =>");
+    for (int i = p->degree; i >= 0; i--)
+    {
+        char out[64];
+        calc_format(ctx, p->c[i], out, sizeof(out));
+        printf(" %s", out);
+    }
+    printf("\n\n");
+}
+
+static int compare_roots(const void *a, const void *b)
+{
+    double complex x = *(const double complex *)a, y = *(const double complex *)b;
+    if (creal(x) != creal(y))
+        return (creal(x) < creal(y)) ? -1 : 1;
+    return (cimag(x) < cimag(y)) ? -1 : (cimag(x) > cimag(y));
+}
+
+typedef struct poly_run
+{
+    calc_ctx *ctx;
+    const calc_poly *p;
+} poly_run;
+
+static void poly_sink(void *arg, const double *x, size_t n)
+{
+    static double out[NUMBER_CHUNK];
+    poly_run *r = arg;
+
+    calc_poly_eval_column(r->p, x, out, n);
+    for (size_t i = 0; i < n; i++)
+    {
+        char buf[64];
+        calc_format(r->ctx, out[i], buf, sizeof(buf));
+        printf("  %s\n", buf);
+    }
+    calc_set_var(r->ctx, "ans", out[n - 1]);
+}
+
+static void run_poly(calc_ctx *ctx, const char *cmd, char *line)
+{
+    static calc_poly p, q;
+    static double complex roots[CALC_POLY_MAX_DEGREE];
+    char *text = strstr(line, cmd) + strlen(cmd);
+
+    int err = parse_poly(&text, &p);
+    if (err == 0 && strcmp(cmd, "polymul") == 0)
+    {
+        if (*text != '*')
+            err = 2;
+        else
+        {
+            text++;
+            err = parse_poly(&text, &q);
+        }
+    }
+    if (err == 0 && *text != '\0' && strcmp(cmd, "polyval") != 0)
+        err = 2;
+    if (err == 4)
+    {
+        printf("  => Error: Degree over %d.\n\n", CALC_POLY_MAX_DEGREE);
+        return;
+    }
+    if (err != 0 || (strcmp(cmd, "polyval") == 0 && *text == '\0'))
+    {
+        printf("  => Usage: roots c..., deriv c..., polymul c... * c..., polyval c... files...\n"
+               "     (coefficients highest power first: 1 0 -2 is x^2 - 2)\n\n");
+        return;
+    }
+
+    if (strcmp(cmd, "deriv") == 0)
+    {
+        calc_poly_deriv(&p, &p);
+        print_poly(ctx, &p);
+        return;
+    }
+    if (strcmp(cmd, "polymul") == 0)
+    {
+        if (calc_poly_mul(&p, &q, &p) != 0)
+            printf("  => Error: Degree over %d.\n\n", CALC_POLY_MAX_DEGREE);
+        else
+            print_poly(ctx, &p);
+        return;
+    }
+    if (strcmp(cmd, "polyval") == 0)
+    {
+        poly_run r = { ctx, &p };
+        for (char *src = strtok(text, " \t"); src; src = strtok(NULL, " \t"))
+        {
+            int col;
+            FILE *f = open_source(src, &col);
+            if (!f)
+            {
+                printf("  => Error: Cannot open '%s'.\n\n", src);
+                return;
+            }
+            read_numbers(f, col, poly_sink, &r);
+            fclose(f);
+        }
+        printf("\n");
+        return;
+    }
+
+    err = calc_poly_roots(&p, roots);
+    if (err == -2)
+    {
+        printf("  => Error: The zero polynomial has no finite set of roots.\n\n");
+        return;
+    }
+    if (p.degree == 0)
+    {
+        printf("  => No roots.\n\n");
+        return;
+    }
+    qsort(roots, p.degree, sizeof(roots[0]), compare_roots);
+    for (int i = 0; i < p.degree; i++)
+    {
+        char out[160];
+        format_complex(ctx, roots[i], out, sizeof(out));
+        printf("  %s x%d = %s\n", (i == 0) ? "=>" : "  ", i + 1, out);
+    }
+    if (err == 5)
+        printf("     (did not fully converge)\n");
+    printf("\n");
+}
+
+/*
+ * Script mode: "Calcultor -f script.calc" runs a file of formulas without the
+ * banner or prompts. Lines are "name = formula", a formula (its value is
+ * printed), "0 deg N" / "0 prec N" / "0 seed N", or "#" comments. The compiled
+ * programs are kept in "script.calc.cache", a flat file of fixed-layout
+ * records tagged with the script's FNV-1a hash; later runs whose script hash
+ * matches load the programs with a few freads instead of re-parsing. A cache
+ * that fails its payload hash or calc_prog_check() is recompiled instead.
+ */
+#define SCRIPT_MAGIC    0x31534343u   /* "CCS1" */
+#define SCRIPT_VERSION  2
+#define SCRIPT_TEXT     (256 * 1024)
+#define SCRIPT_MAX      256           /* statements per script */
+
+enum { STMT_PRINT, STMT_ASSIGN, STMT_DEG, STMT_PREC, STMT_SEED };
+
+typedef struct script_header
+{
+    unsigned magic, version;
+    unsigned ins_size, op_count;   /* layout of calc_ins and the operator table it indexes */
+    unsigned long long hash;       /* of the script text */
+    int stmt_count, var_count;
+    unsigned long long check;      /* FNV-1a of everything after the header */
+} script_header;
+
+typedef struct script_stmt
+{
+    int kind;                  /* STMT_* */
+    int line;                  /* for error messages */
+    int var;                   /* assignment target slot */
+    int len, depth;            /* program size; its instructions follow all statements */
+    unsigned long long arg;    /* setting value */
+} script_stmt;
+
+typedef struct script
+{
+    script_header head;
+    char var_names[CALC_MAX_VARS][CALC_MAX_NAME];
+    script_stmt stmt[SCRIPT_MAX];
+    calc_prog prog[SCRIPT_MAX];
+} script;
+
+static const char *error_text(int err)
+{
+    if (err == -1)
+        return "Division by zero";
+    if (err == -2)
+        return "Invalid input (domain error)";
+    if (err == 1)
+        return "Unknown function";
+    if (err == 3)
+        return "Unknown variable";
+    if (err == 4)
+        return "Expression too large";
+    return "Syntax error";
+}
+
+#define FNV_OFFSET  0xCBF29CE484222325ull
+
+/* Continues the FNV-1a hash h over len more bytes */
+static unsigned long long fnv1a(unsigned long long h, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ p[i]) * 0x100000001B3ull;
+    return h;
+}
+
+/* Hash of the cache payload: names, statements and programs, as stored */
+static unsigned long long script_check(const script *sc)
+{
+    unsigned long long h = fnv1a(FNV_OFFSET, sc->var_names, (size_t)CALC_MAX_NAME * sc->head.var_count);
+    h = fnv1a(h, sc->stmt, sizeof(script_stmt) * sc->head.stmt_count);
+    for (int i = 0; i < sc->head.stmt_count; i++)
+        h = fnv1a(h, sc->prog[i].code, sizeof(calc_ins) * sc->stmt[i].len);
+    return h;
+}
+
+static void script_header_init(script_header *h, unsigned long long hash)
+{
+    memset(h, 0, sizeof(*h));
+    h->magic = SCRIPT_MAGIC;
+    h->version = SCRIPT_VERSION;
+    h->ins_size = sizeof(calc_ins);
+    h->op_count = CALC_OP_COUNT;
+    h->hash = hash;
+}
+
+/* Returns 0 when cache holds the programs of a script with this hash */
+static int script_load(script *sc, const char *cache, unsigned long long hash)
+{
+    script_header want;
+    FILE *f = fopen(cache, "rb");
+    int ok;
+
+    if (!f)
+        return -1;
+    script_header_init(&want, hash);
+    ok = fread(&sc->head, sizeof(sc->head), 1, f) == 1 &&
+         memcmp(&sc->head, &want, offsetof(script_header, stmt_count)) == 0 &&
+         sc->head.stmt_count >= 0 && sc->head.stmt_count <= SCRIPT_MAX &&
+         sc->head.var_count >= 0 && sc->head.var_count <= CALC_MAX_VARS &&
+         fread(sc->var_names, CALC_MAX_NAME, sc->head.var_count, f) == (size_t)sc->head.var_count &&
+         fread(sc->stmt, sizeof(script_stmt), sc->head.stmt_count, f) == (size_t)sc->head.stmt_count;
+    for (int i = 0; ok && i < sc->head.var_count; i++)
+        ok = memchr(sc->var_names[i], '\0', CALC_MAX_NAME) != NULL;
+
+    /* A damaged or edited cache must not reach calc_run(): it trusts its programs */
+    for (int i = 0; ok && i < sc->head.stmt_count; i++)
+    {
+        script_stmt *st = &sc->stmt[i];
+        ok = st->kind >= STMT_PRINT && st->kind <= STMT_SEED &&
+             (st->kind != STMT_ASSIGN || (st->var >= 0 && st->var < sc->head.var_count));
+        if (ok && (st->kind == STMT_PRINT || st->kind == STMT_ASSIGN))
+        {
+            ok = st->len > 0 && st->len <= CALC_PROG_MAX &&
+                 fread(sc->prog[i].code, sizeof(calc_ins), st->len, f) == (size_t)st->len;
+            sc->prog[i].len = st->len;
+            sc->prog[i].depth = st->depth;
+            ok = ok && calc_prog_check(&sc->prog[i], sc->head.var_count) == 0;
+        }
+        else
+            ok = ok && st->len == 0;
+    }
+    ok = ok && fgetc(f) == EOF && script_check(sc) == sc->head.check;
+    fclose(f);
+    return ok ? 0 : -1;
+}
+
+/* Opens a new file next to cache under a name no other run is using; tmp gets the name */
+static FILE *script_tmp_open(const char *cache, char *tmp, size_t size)
+{
+#if defined(__unix__) || defined(__APPLE__)
+    if (snprintf(tmp, size, "%s.XXXXXX", cache) >= (int)size)
+        return NULL;
+    int fd = mkstemp(tmp);
+    if (fd >= 0)
+    {
+        /* mkstemp() creates the file 0600; give the cache fopen()'s usual permissions */
+        mode_t mask = umask(0);
+        umask(mask);
+        fchmod(fd, 0666 & ~mask);
+    }
+    FILE *f = (fd < 0) ? NULL : fdopen(fd, "wb");
+    if (fd >= 0 && !f)
+    {
+        close(fd);
+        remove(tmp);
+    }
+    return f;
+#else
+    /* Without mkstemp(), the time and the address of a stack buffer tell concurrent runs apart */
+    if (snprintf(tmp, size, "%s.%lx%lx.tmp", cache, (unsigned long)time(NULL),
+                 (unsigned long)(size_t)tmp) >= (int)size)
+        return NULL;
+    return fopen(tmp, "wb");
+#endif
+}
+
+/*
+ * Written under a unique temporary name and renamed into place. On POSIX the
+ * rename is atomic, so a concurrent run sees the old cache or the new one;
+ * elsewhere the old file is removed first, and a run in that window finds no
+ * cache and compiles. Either way script_load() checks the payload hash.
+ */
+static void script_save(script *sc, const char *cache)
+{
+    char tmp[FILENAME_MAX];
+    FILE *f;
+    int ok;
+
+    sc->head.check = script_check(sc);
+    if (!(f = script_tmp_open(cache, tmp, sizeof(tmp))))
+        return;
+    ok = fwrite(&sc->head, sizeof(sc->head), 1, f) == 1 &&
+         fwrite(sc->var_names, CALC_MAX_NAME, sc->head.var_count, f) == (size_t)sc->head.var_count &&
+         fwrite(sc->stmt, sizeof(script_stmt), sc->head.stmt_count, f) == (size_t)sc->head.stmt_count;
+    for (int i = 0; ok && i < sc->head.stmt_count; i++)
+        ok = fwrite(sc->prog[i].code, sizeof(calc_ins), sc->stmt[i].len, f) == (size_t)sc->stmt[i].len;
+    if (fclose(f) != 0 || !ok)
+    {
+        remove(tmp);
+        return;
+    }
+#if !defined(__unix__) && !defined(__APPLE__)
+    remove(cache);  /* rename() may not replace an existing file */
+#endif
+    if (rename(tmp, cache) != 0)
+    {
+        fprintf(stderr, "Warning: cannot write '%s'; the script will be compiled again next run.\n", cache);
+        remove(tmp);
+    }
+}
+
+/* Compiles the script text; prints file:line and returns nonzero on the first bad line */
+static int script_compile(script *sc, const char *path, char *text, unsigned long long hash)
+{
+    static char arena_buf[ARENA_SIZE];
+    calc_arena arena;
+    calc_ctx ctx;
+    int lineno = 0;
+
+    calc_init(&ctx);
+    calc_set_var(&ctx, "ans", 0);
+    calc_arena_init(&arena, arena_buf, sizeof(arena_buf));
+    script_header_init(&sc->head, hash);
+
+    for (char *line = text, *next; line; line = next)
+    {
+        char name[64], op[CALC_MAX_OP], arg[64], extra;
+        const char *formula = line;
+        calc_node *tree;
+        size_t pos = 0;
+        int err;
+
+        next = strchr(line, '\n');
+        if (next)
+            *next++ = '\0';
+        line[strcspn(line, "\r")] = '\0';
+        lineno++;
+
+        int ntok = sscanf(line, "%63s %15s %63s %c", name, op, arg, &extra);
+        if (ntok <= 0 || name[0] == '#')
+            continue;
+        if (sc->head.stmt_count == SCRIPT_MAX)
+        {
+            fprintf(stderr, "%s:%d: Error: More than %d statements.\n", path, lineno, SCRIPT_MAX);
+            return -1;
+        }
+        script_stmt *st = &sc->stmt[sc->head.stmt_count];
+        memset(st, 0, sizeof(*st));
+        st->line = lineno;
+        st->kind = STMT_PRINT;
+
+        if (ntok == 3 && (strcmp(op, "deg") == 0 || strcmp(op, "prec") == 0 || strcmp(op, "seed") == 0))
+        {
+            st->kind = (op[0] == 'd') ? STMT_DEG : (op[0] == 'p') ? STMT_PREC : STMT_SEED;
+            st->arg = strtoull(arg, NULL, 10);
+            sc->head.stmt_count++;
+            continue;
+        }
+        if (ntok >= 2 && strcmp(op, "=") == 0)
+        {
+            if ((!isalpha((unsigned char)name[0]) && name[0] != '_') || strlen(name) >= CALC_MAX_NAME)
+            {
+                fprintf(stderr, "%s:%d: Error: Invalid variable name '%s'.\n", path, lineno, name);
+                return -1;
+            }
+            st->kind = STMT_ASSIGN;
+            formula = strchr(line, '=') + 1;
+        }
+
+        calc_arena_reset(&arena);
+        err = calc_parse(&ctx, &arena, formula, &tree, &pos);
+        if (err == 0 && calc_compile(tree, &sc->prog[sc->head.stmt_count]) != 0)
+            err = 4;
+        if (err != 0)
+        {
+            fprintf(stderr, "%s:%d:%zu: Error: %s.\n", path, lineno,
+                    (size_t)(formula - line) + pos + 1, error_text(err));
+            return err;
+        }
+        if (st->kind == STMT_ASSIGN)
+        {
+            /* Created after parsing, so "n = n + 1" needs n from an earlier line */
+            if (calc_var_index(&ctx, name) < 0 && calc_set_var(&ctx, name, 0) != 0)
+            {
+                fprintf(stderr, "%s:%d: Error: Too many variables.\n", path, lineno);
+                return -1;
+            }
+            st->var = calc_var_index(&ctx, name);
+        }
+        st->len = sc->prog[sc->head.stmt_count].len;
+        st->depth = sc->prog[sc->head.stmt_count].depth;
+        sc->head.stmt_count++;
+    }
+
+    sc->head.var_count = ctx.var_count;
+    memcpy(sc->var_names, ctx.var_names, sizeof(ctx.var_names[0]) * ctx.var_count);
+    return 0;
+}
+
+static int run_script(const char *path)
+{
+    static char text[SCRIPT_TEXT + 1];
+    static script sc;
+    char cache[FILENAME_MAX];
+    calc_ctx ctx;
+    FILE *f = fopen(path, "rb");
+
+    if (!f)
+    {
+        fprintf(stderr, "Cannot open '%s'.\n", path);
+        return 1;
+    }
+    size_t len = fread(text, 1, sizeof(text), f);
+    fclose(f);
+    if (len > SCRIPT_TEXT)
+    {
+        fprintf(stderr, "%s: Script larger than %d bytes.\n", path, SCRIPT_TEXT);
+        return 1;
+    }
+    text[len] = '\0';
+
+    unsigned long long hash = fnv1a(FNV_OFFSET, text, len);
+    int cached = snprintf(cache, sizeof(cache), "%s.cache", path) < (int)sizeof(cache);
+    if (!cached || script_load(&sc, cache, hash) != 0)
+    {
+        if (script_compile(&sc, path, text, hash) != 0)
+            return 1;
+        if (cached)
+            script_save(&sc, cache);
+    }
+
+    /* Slots are recreated in compile order, so the programs' var indices line up */
+    calc_init(&ctx);
+    for (int i = 0; i < sc.head.var_count; i++)
+        calc_set_var(&ctx, sc.var_names[i], 0);
+
+    for (int i = 0; i < sc.head.stmt_count; i++)
+    {
+        const script_stmt *st = &sc.stmt[i];
+        double result;
+        char out[64];
+
+        switch (st->kind)
+        {
+            case STMT_DEG: ctx.degree_mode = st->arg != 0; continue;
+            case STMT_PREC: ctx.precision = (st->arg < 1) ? 1 : (st->arg > 17) ? 17 : (int)st->arg; continue;
+            case STMT_SEED: ctx.rng_seed = st->arg; ctx.rng_counter = 0; continue;
+            default: break;
+        }
+        int err = calc_run(&ctx, &sc.prog[i], &result);
+        ctx.rng_counter++;
+        if (err != 0)
+        {
+            fprintf(stderr, "%s:%d: Error: %s.\n", path, st->line, error_text(err));
+            return 1;
+        }
+        if (st->kind == STMT_ASSIGN)
+        {
+            ctx.var_values[st->var] = result;
+            continue;
+        }
+        ctx.var_values[0] = result;  /* ans */
+        calc_format(&ctx, result, out, sizeof(out));
+        puts(out);
+    }
+    return 0;
+}
+
+/*
+ * Pipeline mode: "Calcultor -p 'map x*1.2 | filter x > 0 | reduce +' [files...]"
+ * streams every number of the files (stdin if none; "file@N" for field N only)
+ * through the stages, then prints the reduction, or each surviving value when
+ * the pipeline has no reduce stage.
+ */
+typedef struct pipe_run
+{
+    calc_ctx *ctx;
+    calc_pipe *pipe;
+} pipe_run;
+
+static void pipe_sink(void *arg, const double *x, size_t n)
+{
+    static double out[NUMBER_CHUNK];
+    pipe_run *r = arg;
+
+    size_t kept = calc_pipe_push(r->ctx, r->pipe, x, n, out);
+    r->ctx->rng_counter += n;
+    for (size_t i = 0; i < kept; i++)
+    {
+        char buf[64];
+        calc_format(r->ctx, out[i], buf, sizeof(buf));
+        puts(buf);
+    }
+}
+
+static int run_pipe(const char *text, char **files, int nfiles)
+{
+    static char arena_buf[ARENA_SIZE];
+    static calc_pipe pipe;
+    calc_arena arena;
+    calc_ctx ctx;
+    size_t pos = 0;
+    double result;
+
+    calc_init(&ctx);
+    calc_set_var(&ctx, "x", 0);
+    calc_arena_init(&arena, arena_buf, sizeof(arena_buf));
+    int err = calc_pipe_parse(&ctx, &arena, text, calc_var_index(&ctx, "x"), &pipe, &pos);
+    if (err != 0)
+    {
+        fprintf(stderr, "%s\n%*s^ Error: %s.\n", text, (int)pos, "",
+                err == 1 ? "Unknown stage, function or operator" : error_text(err));
+        return 2;
+    }
+
+    pipe_run r = { &ctx, &pipe };
+    if (nfiles == 0)
+        read_numbers(stdin, 0, pipe_sink, &r);
+    for (int i = 0; i < nfiles; i++)
+    {
+        int col;
+        FILE *f = open_source(files[i], &col);
+        if (!f)
+        {
+            fprintf(stderr, "Cannot open '%s'.\n", files[i]);
+            return 1;
+        }
+        read_numbers(f, col, pipe_sink, &r);
+        fclose(f);
+    }
+
+    if (pipe.reduce < 0)
+        return 0;
+    err = calc_pipe_result(&pipe, &result);
+    if (err != 0)
+    {
+        fprintf(stderr, "Error: %s.\n", err == -2 ? "No values to reduce" : error_text(err));
+        return 1;
+    }
+    char out[64];
+    calc_format(&ctx, result, out, sizeof(out));
+    puts(out);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    char line[MAX_LINE];
+    char op[CALC_MAX_OP];
+    char sa[64], sb[64], extra;
+    double result;
+    int complex_mode = 0;
+    int diff_mode = 0;
+    int rational_mode = 0;
+    static char arena_buf[ARENA_SIZE];
+    calc_arena arena;
+    calc_ctx ctx;
+
+    if (argc == 3 && strcmp(argv[1], "-f") == 0)
+        return run_script(argv[2]);
+    if (argc >= 3 && strcmp(argv[1], "-p") == 0)
+        return run_pipe(argv[2], argv + 3, argc - 3);
+    if (argc != 1)
+    {
+        fprintf(stderr, "Usage: %s [-f script.calc | -p 'map f | filter f | reduce op' [files...]]\n", argv[0]);
+        return 2;
+    }
+
+    calc_init(&ctx);
+    calc_arena_init(&arena, arena_buf, sizeof(arena_buf));
+    cache_clear(&ctx);
 
     printf("=== Calculator (Basic + Scientific) ===\n\n");
-    printf("Basic:     + - * / %% ^ p(percent) //(quotient)\n");
+    printf("Basic:     + - * / %% ^ p(percent) //(quotient)  < <= > >= == != (1 or 0)\n");
     printf("Scientific: sqrt sin cos tan asin acos atan sinh cosh tanh\n");
     printf("            log ln exp abs fact floor ceil inv neg pi e\n");
+    printf("Complex:   conj re im arg, 2i, sqrt(-1)  (toggle: 0 complex 1 / 0 complex 0)\n");
+    printf("Variables: x = 5, then x * 2; ans is the last result\n");
+    printf("Settings:  0 deg 1 / 0 deg 0, 0 prec 12, 0 diff 1 (derivatives), 0 rational 1 (exact)\n");
     printf("Format: number operator number  (unary: number op 0)\n");
+    printf("    or: a formula such as 2*sin(x)^2 + pow(3, 2) - 4!\n");
+    printf("Solve:  solve lo hi formula  (root in x, e.g. solve 0 2 x^2 - 2)\n");
+    printf("Calculus: integrate sin(x) 0 pi, sum 1/k^2 k=1..1000\n");
+    printf("Random: rand() randn(), 0 seed 42, montecarlo 1e6 exp(randn())\n");
+    printf("Streams: quantile 0.5,0.99 data.txt, distinct data.csv@2, sketch out.sketch data.txt\n");
+    printf("Polynomials: roots 1 0 -2, deriv 1 0 -2, polymul 1 1 * 1 -1, polyval 1 0 -2 data.txt\n");
     printf("Quit: 0 quit 0\n\n");
 
     for (;;)
     {
-        printf("> ");
-        if (scanf("%lf %15s %lf", &a, op, &b) != 3)
+        printf(complex_mode ? "C> " : rational_mode ? "Q> " : "> ");
+        if (!fgets(line, sizeof(line), stdin))
             break;
+        line[strcspn(line, "\r\n")] = '\0';
 
-        if (strcmp(op, "quit") == 0 || strcmp(op, "q") == 0)
+        int ntok = sscanf(line, "%63s %15s %63s %c", sa, op, sb, &extra);
+        if (ntok <= 0)
+            continue;
+        if (ntok == 1 && (strcmp(sa, "quit") == 0 || strcmp(sa, "q") == 0))
+            break;
+        if (ntok == 3 && (strcmp(op, "quit") == 0 || strcmp(op, "q") == 0))
             break;
 
-        int err = compute(a, b, op, &result);
-        if (err == 0)
-            printf("  => %.10g\n\n", result);
-        else if (err == -1)
-            printf("  => Error: Division by zero.\n\n");
-        else if (err == -2)
-            printf("  => Error: Invalid input (domain error).\n\n");
-        else
-            printf("  => Error: Unknown operator '%s'.\n\n", op);
+        if (ntok == 3 && strcmp(op, "complex") == 0)
+        {
+            complex_mode = atof(sb) != 0;
+            printf("  => Complex mode %s.\n\n", complex_mode ? "on" : "off");
+            continue;
+        }
+        if (ntok == 3 && strcmp(op, "rational") == 0)
+        {
+            rational_mode = atof(sb) != 0;
+            printf("  => Rational mode %s.\n\n", rational_mode ? "on" : "off");
+            continue;
+        }
+        if (ntok == 3 && strcmp(op, "diff") == 0)
+        {
+            diff_mode = atof(sb) != 0;
+            printf("  => Diff mode %s.\n\n", diff_mode ? "on" : "off");
+            continue;
+        }
+        if (ntok == 3 && strcmp(op, "deg") == 0)
+        {
+            ctx.degree_mode = atof(sb) != 0;
+            printf("  => Angles in %s.\n\n", ctx.degree_mode ? "degrees" : "radians");
+            continue;
+        }
+        if (ntok == 3 && strcmp(op, "seed") == 0)
+        {
+            ctx.rng_seed = strtoull(sb, NULL, 10);
+            ctx.rng_counter = 0;
+            printf("  => Seed %llu.\n\n", ctx.rng_seed);
+            continue;
+        }
+        if (ntok == 3 && strcmp(op, "prec") == 0)
+        {
+            int p = atoi(sb);
+            ctx.precision = (p < 1) ? 1 : (p > 17) ? 17 : p;
+            printf("  => Precision %d digits.\n\n", ctx.precision);
+            continue;
+        }
+        if (ntok >= 2 && strcmp(op, "=") == 0)
+        {
+            if ((!isalpha((unsigned char)sa[0]) && sa[0] != '_') || strlen(sa) >= CALC_MAX_NAME)
+            {
+                printf("  => Error: Invalid variable name '%s'.\n\n", sa);
+                continue;
+            }
+            if (complex_mode)
+            {
+                double complex z;
+                if (run_expression_complex(&ctx, &arena, strchr(line, '=') + 1, &z) != 0)
+                    continue;
+                if (cimag(z) != 0)
+                {
+                    printf("  => Error: Variables hold real numbers only.\n\n");
+                    continue;
+                }
+                result = creal(z);
+            }
+            else if (run_expression(&ctx, strchr(line, '=') + 1, &result) != 0)
+                continue;
+            if (calc_set_var(&ctx, sa, result) != 0)
+                printf("  => Error: Too many variables.\n\n");
+            else
+            {
+                char out[64];
+                calc_format(&ctx, result, out, sizeof(out));
+                printf("  => %s = %s\n\n", sa, out);
+            }
+            continue;
+        }
+
+        if (strcmp(sa, "solve") == 0)
+        {
+            run_solve(&ctx, &arena, line);
+            continue;
+        }
+        if (strcmp(sa, "montecarlo") == 0)
+        {
+            run_montecarlo(&ctx, &arena, line);
+            continue;
+        }
+        if (strcmp(sa, "integrate") == 0)
+        {
+            run_integrate(&ctx, &arena, line);
+            continue;
+        }
+        if (strcmp(sa, "sum") == 0)
+        {
+            run_sum(&ctx, &arena, line);
+            continue;
+        }
+        if (strcmp(sa, "quantile") == 0 || strcmp(sa, "distinct") == 0 || strcmp(sa, "sketch") == 0)
+        {
+            run_sketch(&ctx, sa, line);
+            continue;
+        }
+        if (strcmp(sa, "roots") == 0 || strcmp(sa, "deriv") == 0 || strcmp(sa, "polymul") == 0 ||
+            strcmp(sa, "polyval") == 0)
+        {
+            run_poly(&ctx, sa, line);
+            continue;
+        }
+
+        if (ntok == 3 && run_pair(&ctx, sa, op, sb, complex_mode, diff_mode, rational_mode) == 0)
+            continue;
+        if (complex_mode)
+        {
+            double complex z;
+            if (run_expression_complex(&ctx, &arena, line, &z) == 0)
+            {
+                if (cimag(z) == 0)
+                    calc_set_var(&ctx, "ans", creal(z));
+                print_complex(&ctx, z);
+            }
+            continue;
+        }
+        if (rational_mode)
+        {
+            run_expression_rat(&ctx, &arena, line);
+            continue;
+        }
+        if (diff_mode)
+        {
+            run_expression_dual(&ctx, &arena, line);
+            continue;
+        }
+        if (run_expression(&ctx, line, &result) == 0)
+            print_result(&ctx, result);
     }
 
     printf("Done.\n");
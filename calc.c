@@ -0,0 +1,304 @@
+/*
+ * Calculator engine - see calc.h
+ * Operations: + - * / % ^ < <= > >= == != sqrt sin cos tan asin acos atan sinh cosh tanh log ln exp abs fact
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "calc.h"
+
+static double fact(double n)
+{
+    if (n < 0 || n != floor(n))
+        return -1;  /* invalid */
+    if (n <= 1)
+        return 1;
+    double r = 1;
+    for (long i = 2; i <= (long)n; i++)
+        r *= i;
+    return r;
+}
+
+static void to_lower(char *s)
+{
+    for (; *s; s++)
+        if (*s >= 'A' && *s <= 'Z')
+            *s += 32;
+}
+
+/* Operator names, interned once by calc_op_lookup() */
+static const struct { const char *name; int id; } op_names[] =
+{
+    { "+", CALC_OP_ADD }, { "-", CALC_OP_SUB }, { "*", CALC_OP_MUL }, { "/", CALC_OP_DIV },
+    { "%", CALC_OP_MOD }, { "^", CALC_OP_POW }, { "pow", CALC_OP_POW }, { "p", CALC_OP_PERCENT },
+    { "//", CALC_OP_IDIV }, { "<", CALC_OP_LT }, { "<=", CALC_OP_LE }, { ">", CALC_OP_GT },
+    { ">=", CALC_OP_GE }, { "==", CALC_OP_EQ }, { "!=", CALC_OP_NE },
+    { "sqrt", CALC_OP_SQRT }, { "sin", CALC_OP_SIN }, { "cos", CALC_OP_COS }, { "tan", CALC_OP_TAN },
+    { "asin", CALC_OP_ASIN }, { "acos", CALC_OP_ACOS }, { "atan", CALC_OP_ATAN },
+    { "sinh", CALC_OP_SINH }, { "cosh", CALC_OP_COSH }, { "tanh", CALC_OP_TANH },
+    { "log", CALC_OP_LOG }, { "ln", CALC_OP_LN }, { "exp", CALC_OP_EXP }, { "abs", CALC_OP_ABS },
+    { "fact", CALC_OP_FACT }, { "floor", CALC_OP_FLOOR }, { "ceil", CALC_OP_CEIL },
+    { "inv", CALC_OP_INV }, { "neg", CALC_OP_NEG }, { "pi", CALC_OP_PI }, { "e", CALC_OP_E },
+    { "conj", CALC_OP_CONJ }, { "re", CALC_OP_RE }, { "im", CALC_OP_IM }, { "arg", CALC_OP_ARG },
+};
+
+void calc_init(calc_ctx *ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->degree_mode = 0;
+    ctx->precision = 10;
+}
+
+int calc_op_lookup(const char *op)
+{
+    char opbuf[CALC_MAX_OP];
+    strncpy(opbuf, op, CALC_MAX_OP - 1);
+    opbuf[CALC_MAX_OP - 1] = '\0';
+    to_lower(opbuf);
+
+    for (size_t i = 0; i < sizeof(op_names) / sizeof(op_names[0]); i++)
+        if (strcmp(opbuf, op_names[i].name) == 0)
+            return op_names[i].id;
+    return -1;
+}
+
+int calc_op_is_unary(int id)
+{
+    return id >= CALC_OP_SQRT && id < CALC_OP_COUNT;
+}
+
+int calc_is_unary(const char *op)
+{
+    int id = calc_op_lookup(op);
+    return id >= CALC_OP_SQRT && id <= CALC_OP_E;
+}
+
+int calc_compute(const calc_ctx *ctx, double a, double b, const char *op, double *result)
+{
+    return calc_compute_op(ctx, a, b, calc_op_lookup(op), result);
+}
+
+int calc_compute_op(const calc_ctx *ctx, double a, double b, int op, double *result)
+{
+    /* Angle conversion factors for trig input (ain) and inverse-trig output (aout) */
+    double ain = ctx->degree_mode ? CALC_PI / 180.0 : 1.0;
+    double aout = ctx->degree_mode ? 180.0 / CALC_PI : 1.0;
+
+    switch (op)
+    {
+        case CALC_OP_ADD:     *result = a + b; return 0;
+        case CALC_OP_SUB:     *result = a - b; return 0;
+        case CALC_OP_MUL:     *result = a * b; return 0;
+        case CALC_OP_DIV:     if (b == 0) return -1; *result = a / b; return 0;
+        case CALC_OP_MOD:     if ((long)b == 0) return -1; *result = (double)((long)a % (long)b); return 0;
+        case CALC_OP_POW:     *result = pow(a, b); return 0;
+        case CALC_OP_PERCENT: *result = (a / 100.0) * b; return 0;
+        case CALC_OP_IDIV:    if ((long)b == 0) return -1; *result = floor(a / b); return 0;
+        case CALC_OP_LT:      *result = a < b; return 0;
+        case CALC_OP_LE:      *result = a <= b; return 0;
+        case CALC_OP_GT:      *result = a > b; return 0;
+        case CALC_OP_GE:      *result = a >= b; return 0;
+        case CALC_OP_EQ:      *result = a == b; return 0;
+        case CALC_OP_NE:      *result = a != b; return 0;
+
+        /* Unary operations (use 'a', ignore b) */
+        case CALC_OP_SQRT:    if (a < 0) return -2; *result = sqrt(a); return 0;
+        case CALC_OP_SIN:     *result = sin(a * ain); return 0;
+        case CALC_OP_COS:     *result = cos(a * ain); return 0;
+        case CALC_OP_TAN:     *result = tan(a * ain); return 0;
+        case CALC_OP_ASIN:    if (a < -1 || a > 1) return -2; *result = asin(a) * aout; return 0;
+        case CALC_OP_ACOS:    if (a < -1 || a > 1) return -2; *result = acos(a) * aout; return 0;
+        case CALC_OP_ATAN:    *result = atan(a) * aout; return 0;
+        case CALC_OP_SINH:    *result = sinh(a); return 0;
+        case CALC_OP_COSH:    *result = cosh(a); return 0;
+        case CALC_OP_TANH:    *result = tanh(a); return 0;
+        case CALC_OP_LOG:     if (a <= 0) return -2; *result = log10(a); return 0;
+        case CALC_OP_LN:      if (a <= 0) return -2; *result = log(a); return 0;
+        case CALC_OP_EXP:     *result = exp(a); return 0;
+        case CALC_OP_ABS:     *result = fabs(a); return 0;
+        case CALC_OP_FACT:    *result = fact(a); return (*result < 0) ? -2 : 0;
+        case CALC_OP_FLOOR:   *result = floor(a); return 0;
+        case CALC_OP_CEIL:    *result = ceil(a); return 0;
+        case CALC_OP_INV:     if (a == 0) return -1; *result = 1.0 / a; return 0;
+        case CALC_OP_NEG:     *result = -a; return 0;
+        case CALC_OP_PI:      *result = CALC_PI; return 0;
+        case CALC_OP_E:       *result = CALC_E; return 0;
+        default:              return 1;  /* unknown */
+    }
+}
+
+/*
+ * Complex counterpart of calc_compute(): sqrt(-1), ln(-2), asin(2) etc. give
+ * complex results instead of -2. Angles are always radians here. Operators that
+ * only make sense on the real line (% // fact floor ceil) fall back to
+ * calc_compute() when both operands are real.
+ */
+int calc_compute_complex(const calc_ctx *ctx, double complex a, double complex b,
+                         const char *op, double complex *result)
+{
+    return calc_compute_complex_op(ctx, a, b, calc_op_lookup(op), result);
+}
+
+int calc_compute_complex_op(const calc_ctx *ctx, double complex a, double complex b,
+                            int id, double complex *result)
+{
+    switch (id)
+    {
+        case CALC_OP_ADD:     *result = a + b; return 0;
+        case CALC_OP_SUB:     *result = a - b; return 0;
+        case CALC_OP_MUL:     *result = a * b; return 0;
+        case CALC_OP_DIV:     if (b == 0) return -1; *result = a / b; return 0;
+        case CALC_OP_POW:     *result = cpow(a, b); return 0;
+        case CALC_OP_PERCENT: *result = (a / 100.0) * b; return 0;
+
+        case CALC_OP_SQRT:    *result = csqrt(a); return 0;
+        case CALC_OP_SIN:     *result = csin(a); return 0;
+        case CALC_OP_COS:     *result = ccos(a); return 0;
+        case CALC_OP_TAN:     *result = ctan(a); return 0;
+        case CALC_OP_ASIN:    *result = casin(a); return 0;
+        case CALC_OP_ACOS:    *result = cacos(a); return 0;
+        case CALC_OP_ATAN:    if (a == I || a == -I) return -2; *result = catan(a); return 0;
+        case CALC_OP_SINH:    *result = csinh(a); return 0;
+        case CALC_OP_COSH:    *result = ccosh(a); return 0;
+        case CALC_OP_TANH:    *result = ctanh(a); return 0;
+        case CALC_OP_LOG:     if (a == 0) return -2; *result = clog(a) / log(10.0); return 0;
+        case CALC_OP_LN:      if (a == 0) return -2; *result = clog(a); return 0;
+        case CALC_OP_EXP:     *result = cexp(a); return 0;
+        case CALC_OP_ABS:     *result = cabs(a); return 0;
+        case CALC_OP_INV:     if (a == 0) return -1; *result = 1.0 / a; return 0;
+        case CALC_OP_NEG:     *result = -creal(a) + (0 - cimag(a)) * I; return 0;  /* -(1 + 0i) is -1 + 0i, so sqrt(-1) = i */
+        case CALC_OP_CONJ:    *result = conj(a); return 0;
+        case CALC_OP_RE:      *result = creal(a); return 0;
+        case CALC_OP_IM:      *result = cimag(a); return 0;
+        case CALC_OP_ARG:     *result = carg(a); return 0;
+        case CALC_OP_MUL_I:   *result = a * I; return 0;
+        default:              break;
+    }
+
+    /* Real-only operators (including comparisons), evaluated in radians like the rest of this function */
+    calc_ctx rad = *ctx;
+    double r;
+    rad.degree_mode = 0;
+    int err = calc_compute_op(&rad, creal(a), creal(b), id, &r);
+    if (err == 1)
+        return 1;
+    if (cimag(a) != 0 || cimag(b) != 0)
+        return -2;
+    *result = r;
+    return err;
+}
+
+/* digamma(n + 1) = H(n) - Euler's gamma, only needed at the integers fact() accepts */
+static double digamma_int1(double n)
+{
+    double h = 0;
+    for (long k = 1; k <= (long)n; k++)
+        h += 1.0 / k;
+    return h - 0.57721566490153286061;
+}
+
+/*
+ * Partial derivatives of a binary/unary operator at (a, b) given its value r.
+ * Piecewise-constant operators (% // floor ceil) have zero derivative.
+ */
+static void partials(const calc_ctx *ctx, int op, double a, double b, double r,
+                     double *fa, double *fb)
+{
+    double ain = ctx->degree_mode ? CALC_PI / 180.0 : 1.0;
+    double aout = ctx->degree_mode ? 180.0 / CALC_PI : 1.0;
+
+    *fa = 0;
+    *fb = 0;
+    switch (op)
+    {
+        case CALC_OP_ADD:     *fa = 1; *fb = 1; break;
+        case CALC_OP_SUB:     *fa = 1; *fb = -1; break;
+        case CALC_OP_MUL:     *fa = b; *fb = a; break;
+        case CALC_OP_DIV:     *fa = 1 / b; *fb = -a / (b * b); break;
+        case CALC_OP_POW:
+            *fa = (b == 0) ? 0 : b * pow(a, b - 1);
+            *fb = (a > 0) ? r * log(a) : 0;
+            break;
+        case CALC_OP_PERCENT: *fa = b / 100.0; *fb = a / 100.0; break;
+        case CALC_OP_SQRT:    *fa = 0.5 / r; break;
+        case CALC_OP_SIN:     *fa = cos(a * ain) * ain; break;
+        case CALC_OP_COS:     *fa = -sin(a * ain) * ain; break;
+        case CALC_OP_TAN:     { double c = cos(a * ain); *fa = ain / (c * c); } break;
+        case CALC_OP_ASIN:    *fa = aout / sqrt(1 - a * a); break;
+        case CALC_OP_ACOS:    *fa = -aout / sqrt(1 - a * a); break;
+        case CALC_OP_ATAN:    *fa = aout / (1 + a * a); break;
+        case CALC_OP_SINH:    *fa = cosh(a); break;
+        case CALC_OP_COSH:    *fa = sinh(a); break;
+        case CALC_OP_TANH:    *fa = 1 - r * r; break;
+        case CALC_OP_LOG:     *fa = 1 / (a * log(10.0)); break;
+        case CALC_OP_LN:      *fa = 1 / a; break;
+        case CALC_OP_EXP:     *fa = r; break;
+        case CALC_OP_ABS:     *fa = (a > 0) - (a < 0); break;
+        case CALC_OP_FACT:    *fa = r * digamma_int1(a); break;  /* d/dn gamma(n + 1) */
+        case CALC_OP_INV:     *fa = -1 / (a * a); break;
+        case CALC_OP_NEG:     *fa = -1; break;
+        default:              break;
+    }
+}
+
+int calc_compute_dual(const calc_ctx *ctx, const calc_dual *a, const calc_dual *b,
+                      const char *op, calc_dual *result)
+{
+    return calc_compute_dual_op(ctx, a, b, calc_op_lookup(op), result);
+}
+
+int calc_compute_dual_op(const calc_ctx *ctx, const calc_dual *a, const calc_dual *b,
+                         int op, calc_dual *result)
+{
+    double r, fa, fb;
+
+    int err = calc_compute_op(ctx, a->v, b->v, op, &r);
+    if (err != 0)
+        return err;
+    partials(ctx, op, a->v, b->v, r, &fa, &fb);
+
+    /* Reads a and b fully before writing, so result may alias either operand */
+    double d[CALC_DUAL_N];
+    for (int i = 0; i < CALC_DUAL_N; i++)
+        d[i] = fa * a->d[i] + fb * b->d[i];
+    memcpy(result->d, d, sizeof(d));
+    result->v = r;
+    return 0;
+}
+
+int calc_var_index(const calc_ctx *ctx, const char *name)
+{
+    for (int i = 0; i < ctx->var_count; i++)
+        if (strcmp(ctx->var_names[i], name) == 0)
+            return i;
+    return -1;
+}
+
+int calc_set_var(calc_ctx *ctx, const char *name, double value)
+{
+    int i = calc_var_index(ctx, name);
+    if (i < 0)
+    {
+        if (ctx->var_count >= CALC_MAX_VARS || strlen(name) >= CALC_MAX_NAME)
+            return -1;
+        i = ctx->var_count++;
+        strcpy(ctx->var_names[i], name);
+    }
+    ctx->var_values[i] = value;
+    return 0;
+}
+
+int calc_get_var(const calc_ctx *ctx, const char *name, double *value)
+{
+    int i = calc_var_index(ctx, name);
+    if (i < 0)
+        return -1;
+    *value = ctx->var_values[i];
+    return 0;
+}
+
+int calc_format(const calc_ctx *ctx, double val, char *buf, size_t size)
+{
+    return snprintf(buf, size, "%.*g", ctx->precision, val);
+}
@@ -0,0 +1,452 @@
+/*
+ * Calculator engine - reentrant evaluator shared by the CLI and embedders
+ * Sources: calc.c calc_expr.c calc_prog.c calc_solve.c calc_quad.c calc_rand.c calc_rat.c calc_sketch.c
+ *          calc_pipe.c calc_poly.c
+ * Build (static): gcc -O2 -c <sources> && ar rcs libcalc.a *.o
+ * Build (shared): gcc -O2 -shared -fPIC <sources> -o libcalc.so -lm
+ * Add -fopenmp to spread the *_batch functions across cores.
+ * C++ code may include this header; the double complex functions are C only.
+ *
+ * All state lives in a caller-owned calc_ctx; the library has no globals and
+ * never allocates, so any number of contexts can be used from different
+ * threads at once. A single context must not be written by one thread while
+ * another reads it.
+ *
+ * Return codes: 0 ok, -1 division by zero, -2 domain error, 1 unknown operator,
+ * 2 syntax error, 3 unknown variable, 4 arena full, 5 no convergence,
+ * 6 no sign change in a root bracket.
+ */
+
+#ifndef CALC_H
+#define CALC_H
+
+#include <stddef.h>
+#ifndef __cplusplus
+#include <complex.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CALC_PI  3.14159265358979323846
+#define CALC_E   2.71828182845904523536
+
+#define CALC_MAX_OP    16
+#define CALC_MAX_VARS  32
+#define CALC_MAX_NAME  16
+#define CALC_DUAL_N    4   /* derivative directions carried by a calc_dual */
+
+typedef struct calc_ctx
+{
+    int degree_mode;  /* 1 = trig functions take/return degrees, 0 = radians */
+    int precision;    /* significant digits used by calc_format() */
+    int var_count;
+    char var_names[CALC_MAX_VARS][CALC_MAX_NAME];
+    double var_values[CALC_MAX_VARS];
+    unsigned long long rng_seed;     /* key of the counter-based generator behind rand()/randn() */
+    unsigned long long rng_counter;  /* sample number; batch element i uses rng_counter + i */
+} calc_ctx;
+
+/* Interned operator IDs; "^" and "pow" share CALC_OP_POW */
+enum
+{
+    CALC_OP_ADD, CALC_OP_SUB, CALC_OP_MUL, CALC_OP_DIV, CALC_OP_MOD, CALC_OP_POW,
+    CALC_OP_PERCENT, CALC_OP_IDIV,
+    CALC_OP_LT, CALC_OP_LE, CALC_OP_GT, CALC_OP_GE, CALC_OP_EQ, CALC_OP_NE,  /* 1 or 0 */
+    CALC_OP_SQRT, CALC_OP_SIN, CALC_OP_COS, CALC_OP_TAN, CALC_OP_ASIN, CALC_OP_ACOS,
+    CALC_OP_ATAN, CALC_OP_SINH, CALC_OP_COSH, CALC_OP_TANH, CALC_OP_LOG, CALC_OP_LN,
+    CALC_OP_EXP, CALC_OP_ABS, CALC_OP_FACT, CALC_OP_FLOOR, CALC_OP_CEIL, CALC_OP_INV,
+    CALC_OP_NEG, CALC_OP_PI, CALC_OP_E,
+    CALC_OP_CONJ, CALC_OP_RE, CALC_OP_IM, CALC_OP_ARG,  /* complex mode only */
+    CALC_OP_MUL_I,  /* a times i, from literals such as 2i; complex mode only, has no name */
+    CALC_OP_COUNT
+};
+
+/* Forward-mode dual number: value plus its derivative along CALC_DUAL_N seed directions */
+typedef struct calc_dual
+{
+    double v;
+    double d[CALC_DUAL_N];
+} calc_dual;
+
+void calc_init(calc_ctx *ctx);
+
+/* Maps an operator name (any case) to its CALC_OP_* ID, or -1 if unknown */
+int calc_op_lookup(const char *op);
+int calc_op_is_unary(int id);
+int calc_is_unary(const char *op);
+
+/* The *_op variants take an interned ID and skip the name lookup */
+int calc_compute(const calc_ctx *ctx, double a, double b, const char *op, double *result);
+int calc_compute_op(const calc_ctx *ctx, double a, double b, int op, double *result);
+#ifndef __cplusplus  /* C99 double complex has no C++ spelling */
+int calc_compute_complex(const calc_ctx *ctx, double complex a, double complex b,
+                         const char *op, double complex *result);
+int calc_compute_complex_op(const calc_ctx *ctx, double complex a, double complex b,
+                            int op, double complex *result);
+#endif
+
+/* Same operators and error codes as calc_compute(), propagating derivatives by the chain rule */
+int calc_compute_dual(const calc_ctx *ctx, const calc_dual *a, const calc_dual *b,
+                      const char *op, calc_dual *result);
+int calc_compute_dual_op(const calc_ctx *ctx, const calc_dual *a, const calc_dual *b,
+                         int op, calc_dual *result);
+
+/* Variables: set returns -1 when the table is full or the name too long, get returns -1 when unknown */
+int calc_set_var(calc_ctx *ctx, const char *name, double value);
+int calc_get_var(const calc_ctx *ctx, const char *name, double *value);
+int calc_var_index(const calc_ctx *ctx, const char *name);
+
+/* Formats val with ctx->precision significant digits, like "%.*g" */
+int calc_format(const calc_ctx *ctx, double val, char *buf, size_t size);
+
+/*
+ * Expressions (calc_expr.c): infix formulas such as "2*sin(x)^2 + pow(r, 3) - 4!"
+ *
+ * Nodes are bump-allocated from a caller-supplied arena, so parsing never
+ * calls malloc; reset the arena to drop every tree parsed from it at once.
+ * Operator names and variables are resolved to IDs while parsing, so
+ * evaluation does no string work. Variables must exist in the context
+ * before the formula is parsed.
+ */
+
+typedef struct calc_arena
+{
+    char *base;
+    size_t size;
+    size_t used;
+} calc_arena;
+
+enum { CALC_NODE_NUM, CALC_NODE_VAR, CALC_NODE_OP, CALC_NODE_RAND };
+enum { CALC_RAND_UNIFORM, CALC_RAND_NORMAL };  /* op of a CALC_NODE_RAND */
+
+typedef struct calc_node
+{
+    int kind;                 /* CALC_NODE_* */
+    int op;                   /* CALC_OP_* for CALC_NODE_OP, CALC_RAND_* for CALC_NODE_RAND */
+    int var;                  /* variable slot for CALC_NODE_VAR, stream for CALC_NODE_RAND */
+    double num;               /* literal for CALC_NODE_NUM */
+    struct calc_node *a, *b;  /* operands; b is NULL for unary operators */
+} calc_node;
+
+void calc_arena_init(calc_arena *arena, void *buf, size_t size);
+void calc_arena_reset(calc_arena *arena);
+void *calc_arena_alloc(calc_arena *arena, size_t size);
+
+/* On failure returns 2/3/4 (or 1 for an unknown function) and sets *err_pos to the offending offset */
+int calc_parse(const calc_ctx *ctx, calc_arena *arena, const char *text, calc_node **out, size_t *err_pos);
+int calc_eval(const calc_ctx *ctx, const calc_node *node, double *result);
+
+/*
+ * Formulas may contain imaginary literals (2i, or i when no variable is named
+ * i) and conj/re/im/arg; calc_eval() returns 1 for those, calc_eval_complex()
+ * evaluates them with calc_compute_complex_op(). Variables are real.
+ */
+#ifndef __cplusplus
+int calc_eval_complex(const calc_ctx *ctx, const calc_node *node, double complex *result);
+#endif
+
+/*
+ * Compiled formulas (calc_prog.c): a parsed tree flattened into a postfix
+ * program, so hot formulas run as one tight loop instead of a recursive walk.
+ * calc_run_batch() evaluates a program over a column of inputs CALC_LANES
+ * values at a time; each instruction is dispatched once per block and the
+ * arithmetic inner loops are plain arrays the compiler can vectorise.
+ */
+
+#define CALC_PROG_MAX   256   /* instructions per program */
+#define CALC_LANES      8     /* inputs evaluated together by calc_run_batch() */
+#define CALC_HOT_CALLS  64    /* tree evaluations before calc_formula compiles */
+
+typedef struct calc_ins
+{
+    int kind;    /* CALC_NODE_* */
+    int op;      /* CALC_OP_* or CALC_RAND_* */
+    int var;     /* variable slot or random stream */
+    double num;  /* literal */
+} calc_ins;
+
+typedef struct calc_prog
+{
+    int len;
+    int depth;   /* deepest stack the program needs */
+    calc_ins code[CALC_PROG_MAX];
+} calc_prog;
+
+/* Tiered formula: walks the tree until it is hot, then runs the compiled program */
+typedef struct calc_formula
+{
+    const calc_node *root;
+    unsigned long calls;
+    int compiled;
+    calc_prog prog;
+} calc_formula;
+
+/* Returns 0, or 4 when the tree does not fit in CALC_PROG_MAX instructions */
+int calc_compile(const calc_node *root, calc_prog *prog);
+int calc_run(const calc_ctx *ctx, const calc_prog *prog, double *result);
+
+/*
+ * Checks a program that did not come from calc_compile(), e.g. one read back
+ * from a file: operators and variable slots (below var_count) in range, and
+ * a stack that never underflows and ends with one value at the recorded
+ * depth. Returns 0, or 1/2/3 like calc_parse(). calc_run() trusts its input.
+ */
+int calc_prog_check(const calc_prog *prog, int var_count);
+
+/*
+ * Evaluates prog for n inputs, substituting x[i] for variable slot var (other
+ * variables come from ctx). Lanes that hit an error get NaN; returns how many did.
+ */
+size_t calc_run_batch(const calc_ctx *ctx, const calc_prog *prog, int var,
+                      const double *x, double *out, size_t n);
+
+/*
+ * Complex calc_run_batch(): input i is re[i] + im[i] i (im may be NULL for
+ * real inputs), result i goes to out_re[i] and out_im[i]. Lanes are held as
+ * split re/im arrays, so + - * and the sign and conjugate operators run as
+ * plain vectorisable loops; the rest go through calc_compute_complex_op().
+ */
+size_t calc_run_batch_complex(const calc_ctx *ctx, const calc_prog *prog, int var,
+                              const double *re, const double *im, double *out_re, double *out_im, size_t n);
+
+void calc_formula_init(calc_formula *f, const calc_node *root);
+int calc_formula_eval(const calc_ctx *ctx, calc_formula *f, double *result);
+
+/* Evaluates prog at var = x, returning the value and d/dx */
+int calc_run_dual(const calc_ctx *ctx, const calc_prog *prog, int var, double x,
+                  double *fx, double *dfx);
+
+/*
+ * Gradient in one pass: result->d[k] is the derivative with respect to
+ * variable slot vars[k], for n <= CALC_DUAL_N slots (4 otherwise). The
+ * variables a program reads, in first-use order, come from calc_prog_vars(),
+ * which writes up to max slots and returns the full count.
+ */
+int calc_run_grad(const calc_ctx *ctx, const calc_prog *prog, const int *vars, int n, calc_dual *result);
+int calc_prog_vars(const calc_prog *prog, int *vars, int max);
+
+/*
+ * Root finding (calc_solve.c): finds x in [lo, hi] with prog(x) = 0, where var
+ * is the slot of x. f(lo) and f(hi) must differ in sign, otherwise 6 is returned.
+ * calc_solve() runs Newton on the exact derivative from dual numbers, kept
+ * inside the bracket, and falls back to Brent's method if Newton stalls.
+ * Iteration stops within 4 ulp of the root plus DBL_EPSILON * |hi - lo|;
+ * 5 means neither method got there.
+ */
+int calc_solve(const calc_ctx *ctx, const calc_prog *prog, int var, double lo, double hi, double *root);
+int calc_solve_newton(const calc_ctx *ctx, const calc_prog *prog, int var, double lo, double hi, double *root);
+int calc_solve_brent(const calc_ctx *ctx, const calc_prog *prog, int var, double lo, double hi, double *root);
+
+/*
+ * Solves n independent equations prog(x; param = params[i]) = 0 over the same
+ * bracket. status[i] gets each calc_solve() return code; returns how many failed.
+ */
+size_t calc_solve_batch(const calc_ctx *ctx, const calc_prog *prog, int var, int param,
+                        const double *params, double *roots, int *status, size_t n,
+                        double lo, double hi);
+
+/*
+ * Integration and series (calc_quad.c). calc_integrate() applies adaptive
+ * Gauss-Kronrod 7-15 to prog over [a, b] with var as the integration variable,
+ * stopping when the global error estimate is within tol relative to the
+ * result; 5 means the subdivision budget ran out (result is still the best
+ * estimate). calc_sum() adds prog for var = lo..hi with Neumaier compensated
+ * summation; it returns 4 for more than CALC_SUM_MAX terms, and when a term
+ * fails, the error code of the lowest failing term, whose k goes to *bad_term
+ * (may be NULL). Both split their range
+ * into fixed pieces that run in parallel with -fopenmp and are combined in
+ * order, so results do not depend on the thread count. rand() in a summed
+ * term k draws sample ctx->rng_counter + k; every application of the
+ * integration rule draws its own samples.
+ */
+int calc_integrate(const calc_ctx *ctx, const calc_prog *prog, int var, double a, double b,
+                   double tol, double *result, double *abserr);
+#define CALC_SUM_MAX    (1ULL << 36)   /* terms per calc_sum() */
+
+int calc_sum(const calc_ctx *ctx, const calc_prog *prog, int var, long long lo, long long hi,
+             double *result, long long *bad_term);
+
+/*
+ * Random numbers (calc_rand.c). rand() and randn() in a formula are pure
+ * functions of (ctx->rng_seed, sample number, stream): Philox4x32-10 keyed by
+ * the seed, with the sample number and the rand() call's position in the
+ * formula as the counter. Any thread or lane can therefore produce any sample
+ * without shared state, and the same seed always gives the same values.
+ */
+double calc_rand_uniform(unsigned long long seed, unsigned long long sample, unsigned stream);
+double calc_rand_normal(unsigned long long seed, unsigned long long sample, unsigned stream);
+double calc_rand_node(const calc_ctx *ctx, int kind, int stream, unsigned long long sample);
+
+/*
+ * Estimates the mean and variance of prog over n samples numbered from
+ * ctx->rng_counter. Samples are split into fixed blocks (parallel with
+ * -fopenmp) and merged in order, so results are reproducible for any thread
+ * count. A sample that fails to evaluate gives -2.
+ */
+int calc_montecarlo(const calc_ctx *ctx, const calc_prog *prog, long long n,
+                    double *mean, double *variance);
+
+/*
+ * Exact rationals (calc_rat.c). Fractions are held as 128-bit numerator and
+ * denominator; operands that fit in 64 bits take a path whose products cannot
+ * overflow. Results are not reduced after every operation: binary GCD runs
+ * only when an operation would overflow, and in calc_rat_normalize() before
+ * output. A value that still does not fit becomes inexact and carries a double
+ * approximation from then on (the library never allocates, so there is no
+ * heap bignum tier). Operators without exact rational results (sqrt, sin, ...)
+ * are computed in double and marked inexact too.
+ */
+__extension__ typedef __int128 calc_i128;
+
+typedef struct calc_rat
+{
+    calc_i128 num;
+    calc_i128 den;   /* always > 0 */
+    int inexact;     /* 1 when only approx is meaningful */
+    double approx;
+} calc_rat;
+
+void calc_rat_from_int(calc_rat *r, long long n);
+void calc_rat_from_double(calc_rat *r, double v);
+int calc_rat_parse(const char *s, calc_rat *r);   /* "-12.375", "1e-3", "7/8"; 0 on success */
+double calc_rat_value(const calc_rat *r);
+void calc_rat_normalize(calc_rat *r);
+int calc_compute_rat(const calc_ctx *ctx, const calc_rat *a, const calc_rat *b, int op, calc_rat *result);
+int calc_eval_rat(const calc_ctx *ctx, const calc_node *node, calc_rat *result);
+
+/* Writes "num/den = decimal", "integer" or "~decimal (inexact)" */
+int calc_rat_format(const calc_ctx *ctx, const calc_rat *r, char *buf, size_t size);
+
+/*
+ * Streaming sketches (calc_sketch.c): bounded-memory summaries of a number
+ * stream. Quantiles come from a merging t-digest (accurate to a fraction of a
+ * percent of rank, best near the tails), distinct counts from a 2^12-register
+ * HyperLogLog (about 1.6% standard error). A sketch is a fixed-size struct
+ * with no pointers; sketches built separately, per thread or per run, combine
+ * with calc_sketch_merge(), and calc_sketch_save()/load() turn one into a
+ * portable byte string so partial results can be stored and merged later.
+ */
+#define CALC_SKETCH_CENTROIDS  512    /* bound for the t-digest compression of 500 */
+#define CALC_SKETCH_BUFFER     1024   /* points held before a t-digest merge pass */
+#define CALC_SKETCH_HLL_BITS   12
+#define CALC_SKETCH_HLL_REGS   (1 << CALC_SKETCH_HLL_BITS)
+#define CALC_SKETCH_BYTES      (36 + 16 * CALC_SKETCH_CENTROIDS + CALC_SKETCH_HLL_REGS)
+
+typedef struct calc_sketch
+{
+    double count;    /* values added; NaN is ignored */
+    double min, max;
+    int centroids;
+    int buffered;
+    double mean[CALC_SKETCH_CENTROIDS];
+    double weight[CALC_SKETCH_CENTROIDS];
+    double buffer[CALC_SKETCH_BUFFER];
+    unsigned char hll[CALC_SKETCH_HLL_REGS];
+} calc_sketch;
+
+void calc_sketch_init(calc_sketch *s);
+void calc_sketch_add(calc_sketch *s, double x);
+void calc_sketch_merge(calc_sketch *dst, const calc_sketch *src);
+
+/* Adds n values; large columns are split into fixed blocks (parallel with -fopenmp) merged in order */
+void calc_sketch_add_column(calc_sketch *s, const double *x, size_t n);
+
+/* q in [0, 1]; -2 for an empty sketch or q out of range. Flushes buffered points. */
+int calc_sketch_quantile(calc_sketch *s, double q, double *result);
+double calc_sketch_distinct(const calc_sketch *s);
+
+/* save returns the bytes written (at most CALC_SKETCH_BYTES) or 0 if buf is too small; load returns 2 on malformed data */
+size_t calc_sketch_save(calc_sketch *s, void *buf, size_t size);
+int calc_sketch_load(calc_sketch *s, const void *buf, size_t size);
+
+/*
+ * Pipelines (calc_pipe.c): "map x*1.2 | filter x > 0 | reduce +" over a stream
+ * of numbers, where x is the current value. Stages are fused: each chunk of
+ * CALC_PIPE_CHUNK values runs through every stage with calc_run_batch() while
+ * it is in cache, so no stage materialises its output. A map that fails on a
+ * value gives NaN; filter keeps values whose formula is nonzero (NaN is
+ * false). "reduce op" folds the survivors with any binary operator: + (with
+ * Neumaier compensation) and * run in fixed blocks, in parallel with -fopenmp,
+ * combined in order; other operators fold left to right on one thread.
+ */
+#define CALC_PIPE_STAGES  8
+#define CALC_PIPE_CHUNK   256
+
+enum { CALC_STAGE_MAP, CALC_STAGE_FILTER };
+
+typedef struct calc_stage
+{
+    int kind;        /* CALC_STAGE_* */
+    calc_prog prog;
+} calc_stage;
+
+typedef struct calc_pipe
+{
+    int stages;
+    calc_stage stage[CALC_PIPE_STAGES];
+    int var;                   /* slot of x */
+    int reduce;                /* CALC_OP_* of the final reduce stage, or -1 */
+    double acc, comp;          /* running reduction; comp is the sum's compensation */
+    unsigned long long count;  /* values that reached the reduce stage */
+    int status;                /* first error of the reduce fold */
+} calc_pipe;
+
+/* var is the slot of x. Returns like calc_parse(); 1 also means an unknown stage or reduce operator. */
+int calc_pipe_parse(const calc_ctx *ctx, calc_arena *arena, const char *text, int var,
+                    calc_pipe *pipe, size_t *err_pos);
+void calc_pipe_reset(calc_pipe *pipe);
+
+/*
+ * Streams n values through the pipeline; value i uses random sample
+ * ctx->rng_counter + i. Without a reduce stage the survivors are written to
+ * out (which may be x) and their count returned; otherwise they are folded
+ * into the pipeline's running result and 0 is returned.
+ */
+size_t calc_pipe_push(const calc_ctx *ctx, calc_pipe *pipe, const double *x, size_t n, double *out);
+
+/* Result of a reducing pipeline: -2 if nothing reached a reduce other than + or * */
+int calc_pipe_result(const calc_pipe *pipe, double *result);
+
+/*
+ * Polynomials (calc_poly.c), c[i] being the coefficient of x^i. Evaluation
+ * over a column runs Horner on blocks of inputs side by side, so each step
+ * vectorises and blocks run in parallel with -fopenmp; every value is rounded
+ * exactly as calc_poly_eval() would. Products use direct convolution, or an
+ * FFT once both factors reach degree 256 (the FFT result carries rounding
+ * error relative to the largest coefficient, so integer products may come
+ * back as 2.0000000000000004). Roots come from Aberth-Ehrlich iteration.
+ */
+#define CALC_POLY_MAX_DEGREE  1024
+
+typedef struct calc_poly
+{
+    int degree;
+    double c[CALC_POLY_MAX_DEGREE + 1];
+} calc_poly;
+
+/* Takes n coefficients c[0..n-1] and drops zero leading terms; 4 if the degree is over the maximum */
+int calc_poly_set(calc_poly *p, const double *c, int n);
+double calc_poly_eval(const calc_poly *p, double x);
+void calc_poly_eval_column(const calc_poly *p, const double *x, double *out, size_t n);  /* out may be x */
+void calc_poly_deriv(const calc_poly *p, calc_poly *out);
+
+/* out may be a or b; 4 if the product's degree is over the maximum */
+int calc_poly_mul(const calc_poly *a, const calc_poly *b, calc_poly *out);
+
+/*
+ * Writes p->degree roots. Roots of a real polynomial come in conjugate pairs;
+ * one whose imaginary part is within its error bound is returned as real.
+ * -2 for the zero polynomial; 5 if some root did not converge (the best
+ * estimates are still written).
+ */
+#ifndef __cplusplus
+int calc_poly_roots(const calc_poly *p, double complex *roots);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,844 @@
+/*
+ * Calculator engine - timings of the library's hot paths against simpler ways to get the same answer
+ * Build: gcc -O2 calc_bench.c calc.c calc_expr.c calc_prog.c calc_solve.c calc_quad.c calc_rand.c
+ *        calc_rat.c calc_sketch.c calc_pipe.c calc_poly.c -o calc_bench -lm   (add -fopenmp for threads)
+ * Count allocations (GNU ld): add -DCOUNT_ALLOCS -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc
+ * Usage: calc_bench [section] [values]   (default: every section, 1000000 values)
+ *
+ * Sections:
+ *   eval     x runs over the same inputs through
+ *              parse  calc_parse() and calc_eval() for every value, like a new CLI line
+ *              tree   calc_eval() on the parsed tree, one compute() dispatch per node
+ *              tiered calc_formula_eval(): the tree, then the program once hot
+ *              run    calc_run() on the compiled postfix program, one input at a time
+ *              batch  calc_run_batch() on the program, CALC_LANES inputs per dispatch
+ *   complex  calc_run_batch_complex() against calc_eval_complex() per value
+ *   diff     value plus 4 partial derivatives per point: calc_run_grad() in one
+ *            pass against central differences (9 calc_run() calls), with the
+ *            largest relative disagreement
+ *   parse    calc_parse() throughput in MB/s over a buffer of formula lines,
+ *            arena bytes and heap allocations per formula
+ *   threads  evaluations per second with 1, 2, 4, ... threads, each parsing and
+ *            evaluating in its own context and arena (needs -fopenmp)
+ *   rational calc_eval_rat() plus calc_rat_normalize() against calc_eval() in
+ *            double over integer x, with the share of results that stayed exact
+ *            and the largest relative difference from the double result
+ *   sketch   values per second into a calc_sketch (one at a time and by column)
+ *            against keeping every value and sorting it for exact quantiles,
+ *            with the memory each needs and the sketch's worst rank error
+ *   pipe     "map x*1.2 - 3 | filter x > 0 | map sqrt(x) | reduce +" through the
+ *            fused calc_pipe_push() against running each stage with
+ *            calc_run_batch() over the whole column, materialising its output
+ *   script   per statement, the work a script run does without its cache
+ *            (calc_parse() and calc_compile()) against with it (copying the
+ *            stored instructions and calc_prog_check()); whole runs of
+ *            "Calcultor -f" also pay for process start and file I/O
+ *   poly     evaluation at degrees 4 to 1024, ns per value: Horner chained
+ *            through calc_compute_op() as a keypad user would, calc_poly_eval()
+ *            per value, and calc_poly_eval_column(); then calc_poly_mul()
+ *            against direct convolution, and calc_poly_roots() with the
+ *            largest residual |p(z)| relative to sum |c[i] z^i|
+ *   montecarlo  samples per second of calc_montecarlo() against a serial
+ *            calc_run() loop, and with 1, 2, 4, ... threads under -fopenmp,
+ *            where every thread count must give the identical estimate
+ *
+ * Times are wall clock, per value. Each section also checks that its columns
+ * computed the same thing and prints "(differ)" when they did not.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <complex.h>
+#include <time.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "calc.h"
+
+#define BENCH_ARENA  (16 * 1024)
+
+static char arena_buf[BENCH_ARENA];
+
+#ifdef COUNT_ALLOCS
+static unsigned long alloc_count;
+void *__real_malloc(size_t n);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t n);
+void *__wrap_malloc(size_t n) { alloc_count++; return __real_malloc(n); }
+void *__wrap_calloc(size_t n, size_t size) { alloc_count++; return __real_calloc(n, size); }
+void *__wrap_realloc(void *p, size_t n) { alloc_count++; return __real_realloc(p, n); }
+#endif
+
+static double now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/* Parses text in ctx's variables into the shared arena, dropping the previous tree */
+static calc_node *parse(const calc_ctx *ctx, const char *text)
+{
+    static calc_arena arena;
+    calc_node *tree;
+    size_t pos;
+
+    calc_arena_init(&arena, arena_buf, sizeof(arena_buf));
+    if (calc_parse(ctx, &arena, text, &tree, &pos) != 0)
+    {
+        fprintf(stderr, "cannot parse '%s'\n", text);
+        exit(1);
+    }
+    return tree;
+}
+
+static double *inputs(long n)
+{
+    double *x = malloc(n * sizeof(double));
+    if (!x)
+        exit(1);
+    for (long i = 0; i < n; i++)
+        x[i] = (double)i / n;
+    return x;
+}
+
+static void bench_eval(long n)
+{
+    static const char *const formulas[] = {
+        "x*x + 3*x - 2",
+        "(x + 1) * (x - 1) / (x*x + 1)",
+        "2*sin(x)^2 + sqrt(x + 1) - exp(-x)",
+        "((((x*0.5 + 1)*x - 2)*x + 3)*x - 4)*x + 5",
+    };
+    double *x = inputs(n), *out = inputs(n);
+    calc_ctx ctx;
+
+    calc_init(&ctx);
+    calc_set_var(&ctx, "x", 0);
+    int var = calc_var_index(&ctx, "x");
+
+    printf("eval: %ld values, ns per value\n", n);
+    printf("  %-42s %8s %8s %8s %8s %8s\n", "formula", "parse", "tree", "tiered", "run", "batch");
+    for (size_t f = 0; f < sizeof(formulas) / sizeof(formulas[0]); f++)
+    {
+        calc_node *tree = parse(&ctx, formulas[f]);
+        calc_formula tiered;
+        calc_prog prog;
+        double r, sum_parse = 0, sum_tree = 0, sum_tiered = 0, sum_run = 0, sum_batch = 0;
+
+        if (calc_compile(tree, &prog) != 0)
+            exit(1);
+
+        static char line_buf[BENCH_ARENA];
+        calc_arena line_arena;
+        calc_node *line_tree;
+        size_t pos;
+        calc_arena_init(&line_arena, line_buf, sizeof(line_buf));
+        double t = now();
+        for (long i = 0; i < n; i++)
+        {
+            ctx.var_values[var] = x[i];
+            calc_arena_reset(&line_arena);
+            if (calc_parse(&ctx, &line_arena, formulas[f], &line_tree, &pos) == 0 &&
+                calc_eval(&ctx, line_tree, &r) == 0)
+                sum_parse += r;
+        }
+        double parse_s = now() - t;
+
+        t = now();
+        for (long i = 0; i < n; i++)
+        {
+            ctx.var_values[var] = x[i];
+            if (calc_eval(&ctx, tree, &r) == 0)
+                sum_tree += r;
+        }
+        double tree_s = now() - t;
+
+        calc_formula_init(&tiered, tree);
+        t = now();
+        for (long i = 0; i < n; i++)
+        {
+            ctx.var_values[var] = x[i];
+            if (calc_formula_eval(&ctx, &tiered, &r) == 0)
+                sum_tiered += r;
+        }
+        double tiered_s = now() - t;
+
+        t = now();
+        for (long i = 0; i < n; i++)
+        {
+            ctx.var_values[var] = x[i];
+            if (calc_run(&ctx, &prog, &r) == 0)
+                sum_run += r;
+        }
+        double run_s = now() - t;
+
+        t = now();
+        calc_run_batch(&ctx, &prog, var, x, out, n);
+        for (long i = 0; i < n; i++)
+            sum_batch += out[i];
+        double batch_s = now() - t;
+
+        printf("  %-42s %8.1f %8.1f %8.1f %8.1f %8.1f%s\n", formulas[f], parse_s * 1e9 / n, tree_s * 1e9 / n,
+               tiered_s * 1e9 / n, run_s * 1e9 / n, batch_s * 1e9 / n,
+               (sum_parse == sum_tree && sum_tree == sum_tiered && sum_tiered == sum_run && sum_run == sum_batch)
+               ? "" : "  (differ)");
+    }
+    free(x);
+    free(out);
+}
+
+static void bench_complex(long n)
+{
+    static const char *const formulas[] = {
+        "(x + 2i) * (x - 1i) + 3*x",
+        "sqrt(-x - 1) + exp(i*x) * conj(x + 1i)",
+    };
+    double *x = inputs(n), *out_re = inputs(n), *out_im = inputs(n);
+    calc_ctx ctx;
+
+    calc_init(&ctx);
+    calc_set_var(&ctx, "x", 0);
+    int var = calc_var_index(&ctx, "x");
+
+    printf("complex: %ld values, ns per value\n", n);
+    printf("  %-42s %8s %8s\n", "formula", "tree", "batch");
+    for (size_t f = 0; f < sizeof(formulas) / sizeof(formulas[0]); f++)
+    {
+        calc_node *tree = parse(&ctx, formulas[f]);
+        calc_prog prog;
+        double complex z, sum_tree = 0, sum_batch = 0;
+
+        if (calc_compile(tree, &prog) != 0)
+            exit(1);
+
+        double t = now();
+        for (long i = 0; i < n; i++)
+        {
+            ctx.var_values[var] = x[i];
+            if (calc_eval_complex(&ctx, tree, &z) == 0)
+                sum_tree += z;
+        }
+        double tree_s = now() - t;
+
+        t = now();
+        calc_run_batch_complex(&ctx, &prog, var, x, NULL, out_re, out_im, n);
+        for (long i = 0; i < n; i++)
+            sum_batch += out_re[i] + out_im[i] * I;
+        double batch_s = now() - t;
+
+        printf("  %-42s %8.1f %8.1f%s\n", formulas[f], tree_s * 1e9 / n, batch_s * 1e9 / n,
+               (cabs(sum_tree - sum_batch) <= 1e-9 * cabs(sum_tree)) ? "" : "  (differ)");
+    }
+    free(x);
+    free(out_re);
+    free(out_im);
+}
+
+static void bench_diff(long n)
+{
+    const char *text = "x*y + sin(z)*exp(-w) + sqrt(x*x + y*y) / (1 + z*z) + x^w";
+    double *x = inputs(n);
+    calc_ctx ctx;
+    calc_prog prog;
+    calc_dual r;
+    int vars[CALC_DUAL_N];
+    double sum_dual = 0, sum_fd = 0, worst = 0;
+
+    calc_init(&ctx);
+    calc_set_var(&ctx, "x", 0);
+    calc_set_var(&ctx, "y", 1.5);
+    calc_set_var(&ctx, "z", 0.3);
+    calc_set_var(&ctx, "w", 2.5);
+    if (calc_compile(parse(&ctx, text), &prog) != 0 || calc_prog_vars(&prog, vars, CALC_DUAL_N) != CALC_DUAL_N)
+        exit(1);
+
+    double t = now();
+    for (long i = 0; i < n; i++)
+    {
+        ctx.var_values[0] = 0.5 + x[i];
+        if (calc_run_grad(&ctx, &prog, vars, CALC_DUAL_N, &r) == 0)
+        {
+            sum_dual += r.v;
+            for (int k = 0; k < CALC_DUAL_N; k++)
+                sum_dual += r.d[k];
+        }
+    }
+    double dual_s = now() - t;
+
+    t = now();
+    for (long i = 0; i < n; i++)
+    {
+        double f0, hi, lo;
+        ctx.var_values[0] = 0.5 + x[i];
+        calc_run(&ctx, &prog, &f0);
+        sum_fd += f0;
+        for (int k = 0; k < CALC_DUAL_N; k++)
+        {
+            double v = ctx.var_values[vars[k]], h = 1e-6 * (1 + fabs(v));
+            ctx.var_values[vars[k]] = v + h;
+            calc_run(&ctx, &prog, &hi);
+            ctx.var_values[vars[k]] = v - h;
+            calc_run(&ctx, &prog, &lo);
+            ctx.var_values[vars[k]] = v;
+            sum_fd += (hi - lo) / (2 * h);
+        }
+    }
+    double fd_s = now() - t;
+
+    /* Accuracy on a sample of the points */
+    for (long i = 0; i < n; i += (n > 1000) ? n / 1000 : 1)
+    {
+        double hi, lo;
+        ctx.var_values[0] = 0.5 + x[i];
+        calc_run_grad(&ctx, &prog, vars, CALC_DUAL_N, &r);
+        for (int k = 0; k < CALC_DUAL_N; k++)
+        {
+            double v = ctx.var_values[vars[k]], h = 1e-6 * (1 + fabs(v));
+            ctx.var_values[vars[k]] = v + h;
+            calc_run(&ctx, &prog, &hi);
+            ctx.var_values[vars[k]] = v - h;
+            calc_run(&ctx, &prog, &lo);
+            ctx.var_values[vars[k]] = v;
+            worst = fmax(worst, fabs((hi - lo) / (2 * h) - r.d[k]) / (1 + fabs(r.d[k])));
+        }
+    }
+
+    printf("diff: %s, %ld points, ns per point (value + %d derivatives)\n", text, n, CALC_DUAL_N);
+    printf("  dual %.1f   central differences %.1f   largest relative difference %.1e%s\n",
+           dual_s * 1e9 / n, fd_s * 1e9 / n, worst,
+           (fabs(sum_fd - sum_dual) <= 1e-6 * fabs(sum_dual)) ? "" : "  (differ)");
+    free(x);
+}
+
+/* n formula lines built from a few shapes with varying literals, one line after another */
+static void bench_parse(long n)
+{
+    static const char *const shapes[] = {
+        "%d.25*sin(x)^2 + sqrt(y + %d) - exp(-x/%d)",
+        "((((x*0.5 + %d)*x - 2)*x + %d)*x - 4)*x + %d",
+        "pow(y, %d) // 3 + (x >= %d) * abs(x - %d)!",
+        "x*%d + y*%d - %d",
+    };
+    char *text = malloc(n * 64 + 1), *end = text;
+    calc_arena arena;
+    calc_ctx ctx;
+    calc_node *tree;
+    size_t pos, used = 0;
+    long lines = 0, bad = 0;
+
+    if (!text)
+        exit(1);
+    for (long i = 0; i < n && end - text < n * 64 - 64; i++, lines++)
+        end += sprintf(end, shapes[i % 4], (int)(i % 97), (int)(i % 13 + 1), (int)(i % 7 + 1)) + 1;
+    calc_init(&ctx);
+    calc_set_var(&ctx, "x", 0.5);
+    calc_set_var(&ctx, "y", 2);
+    calc_arena_init(&arena, arena_buf, sizeof(arena_buf));
+
+#ifdef COUNT_ALLOCS
+    unsigned long allocs_before = alloc_count;
+#endif
+    double t = now();
+    for (const char *line = text; line < end; line += strlen(line) + 1)
+    {
+        calc_arena_reset(&arena);
+        if (calc_parse(&ctx, &arena, line, &tree, &pos) != 0)
+            bad++;
+        used += arena.used;
+    }
+    double parse_s = now() - t;
+
+    printf("parse: %ld formulas, %.1f MB\n", lines, (end - text) / 1e6);
+    printf("  %.1f MB/s   %.0f ns per formula   %.0f arena bytes per formula", (end - text) / 1e6 / parse_s,
+           parse_s * 1e9 / lines, (double)used / lines);
+#ifdef COUNT_ALLOCS
+    printf("   %lu heap allocations", alloc_count - allocs_before);
+#endif
+    printf("%s\n", bad ? "  (parse errors)" : "");
+    free(text);
+}
+
+/* Every thread owns a context and an arena; nothing is shared but the read-only inputs */
+static void bench_threads(long n)
+{
+    const char *text = "2*sin(x)^2 + sqrt(x + 1) - exp(-x) + abs(x - 0.5)";
+    double *x = inputs(n);
+    int max = 1;
+    double base = 0;
+
+#ifdef _OPENMP
+    max = omp_get_max_threads();
+#endif
+    printf("threads: %ld calc_eval() calls per thread count, one context per thread\n", n);
+    printf("  %8s %14s %8s\n", "threads", "evals/s", "speedup");
+    for (int threads = 1; threads <= max; threads = (threads * 2 > max && threads < max) ? max : threads * 2)
+    {
+        double sums[256] = { 0 };
+        double t = now();
+#ifdef _OPENMP
+        #pragma omp parallel num_threads(threads)
+#endif
+        {
+            int id = 0;
+#ifdef _OPENMP
+            id = omp_get_thread_num();
+#endif
+            char buf[BENCH_ARENA];
+            calc_arena arena;
+            calc_ctx ctx;
+            calc_node *tree;
+            size_t pos;
+            double r, sum = 0;
+
+            calc_init(&ctx);
+            calc_set_var(&ctx, "x", 0);
+            calc_arena_init(&arena, buf, sizeof(buf));
+            if (calc_parse(&ctx, &arena, text, &tree, &pos) == 0)
+                for (long i = id; i < n; i += threads)
+                {
+                    ctx.var_values[0] = x[i];
+                    if (calc_eval(&ctx, tree, &r) == 0)
+                        sum += r;
+                }
+            sums[id % 256] = sum;
+        }
+        double rate = n / (now() - t);
+        if (threads == 1)
+            base = rate;
+        double total = 0;
+        for (int i = 0; i < 256; i++)
+            total += sums[i];
+        printf("  %8d %14.3e %8.2f   (sum %.6g)\n", threads, rate, rate / base, total);
+    }
+    free(x);
+}
+
+static void bench_rational(long n)
+{
+    static const char *const formulas[] = {
+        "x/3 + x/6 - x/2 + 1/7",
+        "(x + 1/3) * (x - 2/5) / (x*x + 1)",
+        "((x/2 + 1/3)/5 + 1/7)/11 + 1/13",
+        "(x + 1/3)^12 - x^12",
+    };
+    calc_ctx ctx;
+
+    calc_init(&ctx);
+    calc_set_var(&ctx, "x", 0);
+    int var = calc_var_index(&ctx, "x");
+
+    printf("rational: %ld values, ns per value\n", n);
+    printf("  %-42s %8s %8s %8s %10s\n", "formula", "double", "exact", "exact %", "max rel");
+    for (size_t f = 0; f < sizeof(formulas) / sizeof(formulas[0]); f++)
+    {
+        calc_node *tree = parse(&ctx, formulas[f]);
+        double r, sum = 0;
+        calc_rat q;
+        long exact = 0;
+
+        double t = now();
+        for (long i = 0; i < n; i++)
+        {
+            ctx.var_values[var] = (double)(i % 1000 - 500);
+            if (calc_eval(&ctx, tree, &r) == 0)
+                sum += r;
+        }
+        double double_s = now() - t;
+
+        t = now();
+        for (long i = 0; i < n; i++)
+        {
+            ctx.var_values[var] = (double)(i % 1000 - 500);
+            if (calc_eval_rat(&ctx, tree, &q) == 0)
+            {
+                calc_rat_normalize(&q);
+                exact += !q.inexact;
+            }
+        }
+        double rat_s = now() - t;
+
+        /* Agreement on the first 1000 inputs, outside the timed loops */
+        double worst = 0;
+        for (long i = 0; i < n && i < 1000; i++)
+        {
+            ctx.var_values[var] = (double)(i - 500);
+            if (calc_eval(&ctx, tree, &r) == 0 && calc_eval_rat(&ctx, tree, &q) == 0 && r != 0)
+            {
+                double rel = fabs(calc_rat_value(&q) - r) / fabs(r);
+                worst = rel > worst ? rel : worst;
+            }
+        }
+        printf("  %-42s %8.1f %8.1f %8.1f %10.1e%s\n", formulas[f], double_s * 1e9 / n, rat_s * 1e9 / n,
+               100.0 * exact / n, worst, (worst <= 1e-12 && isfinite(sum)) ? "" : "  (differ)");
+    }
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void bench_sketch(long n)
+{
+    static const double qs[] = { 0.001, 0.01, 0.5, 0.99, 0.999 };
+    static calc_sketch one, column;
+    double *x = inputs(n), *sorted = inputs(n), est, worst = 0;
+
+    for (long i = 0; i < n; i++)
+        x[i] = calc_rand_normal(1, (unsigned long long)i, 0);
+
+    printf("sketch: %ld values\n", n);
+    printf("  %-26s %14s %12s\n", "method", "values/s", "bytes");
+
+    double t = now();
+    calc_sketch_init(&one);
+    for (long i = 0; i < n; i++)
+        calc_sketch_add(&one, x[i]);
+    calc_sketch_quantile(&one, 0.5, &est);
+    printf("  %-26s %14.3e %12zu\n", "calc_sketch_add", n / (now() - t), sizeof(calc_sketch));
+
+    t = now();
+    calc_sketch_init(&column);
+    calc_sketch_add_column(&column, x, n);
+    calc_sketch_quantile(&column, 0.5, &est);
+    printf("  %-26s %14.3e %12zu   (saved: %d)\n", "calc_sketch_add_column", n / (now() - t),
+           sizeof(calc_sketch), CALC_SKETCH_BYTES);
+
+    t = now();
+    memcpy(sorted, x, n * sizeof(double));
+    qsort(sorted, n, sizeof(double), compare_doubles);
+    printf("  %-26s %14.3e %12zu\n", "store + qsort", n / (now() - t), n * sizeof(double));
+
+    for (size_t k = 0; k < sizeof(qs) / sizeof(qs[0]); k++)
+    {
+        long lo = 0, hi = n;
+        calc_sketch_quantile(&column, qs[k], &est);
+        while (lo < hi)
+        {
+            long mid = lo + (hi - lo) / 2;
+            if (sorted[mid] < est) lo = mid + 1; else hi = mid;
+        }
+        double err = fabs((double)lo / n - qs[k]);
+        worst = err > worst ? err : worst;
+    }
+    printf("  worst rank error at q = 0.001 ... 0.999: %.2e%s\n", worst, worst <= 0.01 ? "" : "  (differ)");
+    free(x);
+    free(sorted);
+}
+
+static void bench_pipe(long n)
+{
+    static calc_pipe pipe;
+    double *x = inputs(n), *a = inputs(n), *b = inputs(n), fused, staged = 0, comp = 0;
+    calc_arena arena;
+    calc_prog map1, filter, map2;
+    calc_ctx ctx;
+    size_t pos;
+
+    calc_init(&ctx);
+    calc_set_var(&ctx, "x", 0);
+    int var = calc_var_index(&ctx, "x");
+    for (long i = 0; i < n; i++)
+        x[i] = calc_rand_normal(3, (unsigned long long)i, 0) * 10;
+    calc_arena_init(&arena, arena_buf, sizeof(arena_buf));
+    if (calc_pipe_parse(&ctx, &arena, "map x*1.2 - 3 | filter x > 0 | map sqrt(x) | reduce +", var, &pipe, &pos) != 0 ||
+        calc_compile(parse(&ctx, "x*1.2 - 3"), &map1) != 0 || calc_compile(parse(&ctx, "x > 0"), &filter) != 0 ||
+        calc_compile(parse(&ctx, "sqrt(x)"), &map2) != 0)
+        exit(1);
+
+    printf("pipe: %ld values, ns per value\n", n);
+    printf("  %-26s %8s %16s\n", "method", "ns", "result");
+
+    double t = now();
+    calc_pipe_reset(&pipe);
+    calc_pipe_push(&ctx, &pipe, x, n, NULL);
+    calc_pipe_result(&pipe, &fused);
+    printf("  %-26s %8.2f %16.9e\n", "fused calc_pipe_push", (now() - t) * 1e9 / n, fused);
+
+    /* One full pass per stage, each writing a column the next one reads */
+    t = now();
+    calc_run_batch(&ctx, &map1, var, x, a, n);
+    calc_run_batch(&ctx, &filter, var, a, b, n);
+    long m = 0;
+    for (long i = 0; i < n; i++)
+    {
+        a[m] = a[i];
+        m += (b[i] != 0 && b[i] == b[i]);
+    }
+    calc_run_batch(&ctx, &map2, var, a, b, m);
+    for (long i = 0; i < m; i++)
+    {
+        double s = staged + b[i];
+        comp += (fabs(staged) >= fabs(b[i])) ? (staged - s) + b[i] : (b[i] - s) + staged;
+        staged = s;
+    }
+    staged += comp;
+    printf("  %-26s %8.2f %16.9e%s\n", "stage by stage", (now() - t) * 1e9 / n, staged,
+           fabs(fused - staged) <= 1e-12 * fabs(staged) ? "" : "  (differ)");
+    free(x);
+    free(a);
+    free(b);
+}
+
+static void bench_script(long n)
+{
+    static const char *const lines[] = {
+        "sin(b)*3 + sqrt(abs(a - 7.5)) / (1 + b^2) - exp(-abs(a))",
+        "a*a + 3*a - 2",
+        "((((a*0.5 + 1)*a - 2)*a + 3)*a - 4)*a + b",
+        "atan(a - b)*cosh(b) + log(abs(a) + 3) / (1 + b^2)",
+    };
+    const int count = sizeof(lines) / sizeof(lines[0]);
+    calc_prog stored[sizeof(lines) / sizeof(lines[0])], prog;
+    calc_ctx ctx;
+    long ok_cold = 0, ok_warm = 0;
+
+    calc_init(&ctx);
+    calc_set_var(&ctx, "a", 0);
+    calc_set_var(&ctx, "b", 0);
+    for (int i = 0; i < count; i++)
+        if (calc_compile(parse(&ctx, lines[i]), &stored[i]) != 0)
+            exit(1);
+
+    printf("script: %ld statements, ns per statement\n", n);
+    printf("  %-30s %10s\n", "path", "ns");
+    double t = now();
+    for (long i = 0; i < n; i++)
+    {
+        calc_node *tree = parse(&ctx, lines[i % count]);
+        ok_cold += calc_compile(tree, &prog) == 0 && prog.len == stored[i % count].len;
+    }
+    printf("  %-30s %10.1f\n", "cold: parse + compile", (now() - t) * 1e9 / n);
+
+    t = now();
+    for (long i = 0; i < n; i++)
+    {
+        const calc_prog *src = &stored[i % count];
+        memcpy(prog.code, src->code, sizeof(calc_ins) * src->len);
+        prog.len = src->len;
+        prog.depth = src->depth;
+        ok_warm += calc_prog_check(&prog, ctx.var_count) == 0;
+    }
+    printf("  %-30s %10.1f%s\n", "warm: copy + calc_prog_check", (now() - t) * 1e9 / n,
+           (ok_cold == n && ok_warm == n) ? "" : "  (differ)");
+}
+
+static void bench_poly(long n)
+{
+    static calc_poly p, q, r;
+    static double complex roots[CALC_POLY_MAX_DEGREE];
+    double *x = inputs(n), *out = inputs(n);
+    calc_ctx ctx;
+
+    calc_init(&ctx);
+    for (long i = 0; i < n; i++)
+        x[i] = 2 * x[i] - 1;
+
+    printf("poly: %ld values, ns per value\n", n);
+    printf("  %8s %10s %10s %10s\n", "degree", "compute", "eval", "column");
+    for (int degree = 4; degree <= CALC_POLY_MAX_DEGREE; degree *= 4)
+    {
+        double c[CALC_POLY_MAX_DEGREE + 1], sum_chain = 0, sum_eval = 0, sum_column = 0, v;
+        for (int i = 0; i <= degree; i++)
+            c[i] = calc_rand_normal(5, (unsigned long long)i, 0) / (i + 1);
+        calc_poly_set(&p, c, degree + 1);
+        long m = n / (degree / 4);  /* about the same work per row */
+
+        double t = now();
+        for (long i = 0; i < m; i++)
+        {
+            v = p.c[p.degree];
+            for (int k = p.degree - 1; k >= 0; k--)
+            {
+                calc_compute_op(&ctx, v, x[i], CALC_OP_MUL, &v);
+                calc_compute_op(&ctx, v, p.c[k], CALC_OP_ADD, &v);
+            }
+            sum_chain += v;
+        }
+        double chain_s = now() - t;
+
+        t = now();
+        for (long i = 0; i < m; i++)
+            sum_eval += calc_poly_eval(&p, x[i]);
+        double eval_s = now() - t;
+
+        t = now();
+        calc_poly_eval_column(&p, x, out, m);
+        for (long i = 0; i < m; i++)
+            sum_column += out[i];
+        double column_s = now() - t;
+
+        printf("  %8d %10.1f %10.1f %10.1f%s\n", degree, chain_s * 1e9 / m, eval_s * 1e9 / m,
+               column_s * 1e9 / m, (sum_chain == sum_eval && sum_eval == sum_column) ? "" : "  (differ)");
+    }
+
+    printf("  %8s %10s %10s   (us per product)\n", "degree", "direct", "mul");
+    for (int degree = 8; degree <= CALC_POLY_MAX_DEGREE / 2; degree *= 2)
+    {
+        double c[CALC_POLY_MAX_DEGREE + 1], direct[CALC_POLY_MAX_DEGREE + 1], worst = 0;
+        int reps = 1 + 20000000 / ((degree + 1) * (degree + 1));
+        for (int i = 0; i <= degree; i++)
+            c[i] = calc_rand_normal(6, (unsigned long long)i, 0);
+        calc_poly_set(&p, c, degree + 1);
+        for (int i = 0; i <= degree; i++)
+            c[i] = calc_rand_normal(7, (unsigned long long)i, 0);
+        calc_poly_set(&q, c, degree + 1);
+
+        double t = now();
+        for (int rep = 0; rep < reps; rep++)
+        {
+            memset(direct, 0, sizeof(double) * (2 * degree + 1));
+            for (int i = 0; i <= degree; i++)
+                for (int j = 0; j <= degree; j++)
+                    direct[i + j] += p.c[i] * q.c[j];
+        }
+        double direct_s = (now() - t) / reps;
+
+        t = now();
+        for (int rep = 0; rep < reps; rep++)
+            calc_poly_mul(&p, &q, &r);
+        double mul_s = (now() - t) / reps;
+
+        for (int k = 0; k <= 2 * degree; k++)
+            worst = fmax(worst, fabs(r.c[k] - direct[k]));
+        printf("  %8d %10.2f %10.2f   (largest difference %.1e)\n", degree, direct_s * 1e6, mul_s * 1e6, worst);
+    }
+
+    printf("  %8s %10s %10s   (roots)\n", "degree", "ms", "residual");
+    for (int degree = 8; degree <= 512; degree *= 4)
+    {
+        double c[CALC_POLY_MAX_DEGREE + 1], worst = 0;
+        for (int i = 0; i <= degree; i++)
+            c[i] = calc_rand_normal(8, (unsigned long long)i, 0);
+        calc_poly_set(&p, c, degree + 1);
+
+        double t = now();
+        int err = calc_poly_roots(&p, roots);
+        double roots_s = now() - t;
+
+        for (int k = 0; k < degree; k++)
+        {
+            double complex v = 0;
+            double scale = 0, az = cabs(roots[k]);
+            for (int i = degree; i >= 0; i--)
+            {
+                v = v * roots[k] + p.c[i];
+                scale = scale * az + fabs(p.c[i]);
+            }
+            worst = fmax(worst, cabs(v) / scale);
+        }
+        printf("  %8d %10.3f %10.1e%s\n", degree, roots_s * 1e3, worst, err == 0 ? "" : "  (did not converge)");
+    }
+    free(x);
+    free(out);
+}
+
+static void bench_montecarlo(long n)
+{
+    calc_ctx ctx, c;
+    calc_prog prog;
+    double mean, variance, f, m = 0;
+
+    calc_init(&ctx);
+    ctx.rng_seed = 2024;
+    if (calc_compile(parse(&ctx, "4*(rand()^2 + rand()^2 <= 1) + 0.1*randn()"), &prog) != 0)
+        exit(1);
+    printf("montecarlo: %ld samples of a pi estimate, samples per second\n", n);
+    printf("  %-22s %14s %12s\n", "method", "samples/s", "mean");
+
+    /* Serial running mean over calc_run(), the same sample numbers as calc_montecarlo() */
+    c = ctx;
+    double t = now();
+    for (long i = 0; i < n; i++)
+    {
+        c.rng_counter = ctx.rng_counter + (unsigned long long)i;
+        if (calc_run(&c, &prog, &f) != 0)
+            exit(1);
+        double d = f - m;
+        m += d / (i + 1);
+    }
+    printf("  %-22s %14.3e %12.8f\n", "calc_run loop", n / (now() - t), m);
+
+    int max = 1;
+#ifdef _OPENMP
+    max = omp_get_max_threads();
+#endif
+    double first = 0;
+    for (int threads = 1; threads <= max; threads = (threads * 2 > max && threads < max) ? max : threads * 2)
+    {
+        char label[32];
+#ifdef _OPENMP
+        omp_set_num_threads(threads);
+#endif
+        t = now();
+        if (calc_montecarlo(&ctx, &prog, n, &mean, &variance) != 0)
+            exit(1);
+        double rate = n / (now() - t);
+        if (threads == 1)
+            first = mean;
+        snprintf(label, sizeof(label), "calc_montecarlo x%d", threads);
+        printf("  %-22s %14.3e %12.8f%s\n", label, rate, mean,
+               (mean == first && fabs(mean - m) <= 1e-12 * fabs(m)) ? "" : "  (differ)");
+    }
+#ifdef _OPENMP
+    omp_set_num_threads(max);
+#endif
+}
+
+static const struct
+{
+    const char *name;
+    void (*run)(long n);
+} sections[] =
+{
+    { "eval", bench_eval },
+    { "complex", bench_complex },
+    { "diff", bench_diff },
+    { "parse", bench_parse },
+    { "threads", bench_threads },
+    { "rational", bench_rational },
+    { "sketch", bench_sketch },
+    { "pipe", bench_pipe },
+    { "script", bench_script },
+    { "poly", bench_poly },
+    { "montecarlo", bench_montecarlo },
+};
+
+int main(int argc, char **argv)
+{
+    const char *only = NULL;
+    long n = 1000000;
+    int ran = 0;
+
+    if (argc > 1 && (argv[1][0] < '0' || argv[1][0] > '9'))
+    {
+        only = argv[1];
+        argc--;
+        argv++;
+    }
+    if (argc > 1)
+        n = atol(argv[1]);
+    if (n < 1)
+    {
+        fprintf(stderr, "Usage: calc_bench [section] [values]\n");
+        return 2;
+    }
+
+    for (size_t s = 0; s < sizeof(sections) / sizeof(sections[0]); s++)
+        if (!only || strcmp(only, sections[s].name) == 0)
+        {
+            sections[s].run(n);
+            ran++;
+        }
+    if (!ran)
+    {
+        fprintf(stderr, "Unknown section '%s'\n", only);
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,870 @@
+/*
+ * Calculator engine - header-only C++20 port of compute() and the formula
+ * evaluator, usable in constant expressions
+ * Build: any C++20 compiler (g++ -std=c++20); nothing to link
+ *
+ * Same operator names, semantics and return codes as calc.h: fact, p
+ * (percent), // (floored quotient), % on truncated integers, comparisons
+ * giving 1 or 0, and err = 0 / -1 / -2 / 1 / 2 / 3 in calc::result.
+ *
+ *   constexpr auto r = calc::eval("2*3^2 + 4!");      // folded by the compiler
+ *   static_assert(r.err == 0 && r.value == 42);
+ *
+ *   constexpr calc::arg<0> x;
+ *   constexpr auto f = calc::sqrt(x * x + 1) - calc::fact(3);
+ *   calc::result y = f(2.5);                           // straight-line code, no dispatch
+ *
+ * At run time the transcendental functions call <cmath>, so results match
+ * calc_compute() bit for bit. During constant evaluation they use series
+ * that calc_constexpr_test.cpp holds within 4 ulps of <cmath> (pow's error
+ * grows with |b ln a|, and trig arguments beyond 2^31 are reduced to an
+ * absolute rather than relative accuracy); literals that need more than 53
+ * bits or a power of ten beyond 1e22 may differ from strtod() in the last bit.
+ * Arithmetic, fact, p, //, %, floor, ceil and comparisons are exact in both.
+ * rand() and randn() are not available (err 1).
+ */
+
+#ifndef CALC_CONSTEXPR_HPP
+#define CALC_CONSTEXPR_HPP
+
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <cstdlib>
+#include <initializer_list>
+#include <string_view>
+#include <type_traits>
+
+namespace calc
+{
+
+inline constexpr double pi = 3.14159265358979323846;
+inline constexpr double e = 2.71828182845904523536;
+
+enum : int { ok = 0, div_by_zero = -1, domain_error = -2, unknown_op = 1, syntax_error = 2, unknown_var = 3 };
+
+/* In CALC_OP_* order; the complex-only operators are not ported */
+enum class op : int
+{
+    add, sub, mul, div, mod, pow, percent, idiv,
+    lt, le, gt, ge, eq, ne,
+    sqrt, sin, cos, tan, asin, acos, atan, sinh, cosh, tanh, log, ln,
+    exp, abs, fact, floor, ceil, inv, neg, pi, e,
+    none
+};
+
+struct result
+{
+    double value = 0;
+    int err = ok;
+    std::size_t err_pos = 0;  /* offset of a parse error in calc::eval() */
+};
+
+struct context
+{
+    bool degree_mode = false;  /* trig functions take/return degrees */
+};
+
+struct var
+{
+    std::string_view name;
+    double value;
+};
+
+namespace detail
+{
+
+inline constexpr double ln2_hi = 6.93147180369123816490e-01;
+inline constexpr double ln2_lo = 1.90821492927058770002e-10;
+/* 2 pi in three parts (Cody-Waite); k * part is exact for |k| < 2^32 */
+inline constexpr double two_pi_1 = 6.283184051513672;
+inline constexpr double two_pi_2 = 1.2556656656670384e-06;
+inline constexpr double two_pi_3 = 2.4893488687586454e-13;
+
+constexpr double fabs_(double x) { return (x < 0) ? -x : x; }
+
+constexpr double floor_(double x)
+{
+    if (!(x == x) || fabs_(x) >= 4503599627370496.0)  /* NaN, inf, or already integral */
+        return x;
+    double d = static_cast<double>(static_cast<long long>(x));
+    return (d > x) ? d - 1 : d;
+}
+
+constexpr double ceil_(double x) { return -floor_(-x); }
+
+/* x * 2^k by exact doublings */
+constexpr double scale2(double x, int k)
+{
+    for (; k > 0; k--) x *= 2;
+    for (; k < 0; k++) x *= 0.5;
+    return x;
+}
+
+constexpr double exp_(double x)
+{
+    if (x != x) return x;
+    if (x > 709.782712893384) return HUGE_VAL;
+    if (x < -745.1332191019412) return 0;
+    int k = static_cast<int>(x / (ln2_hi + ln2_lo) + (x < 0 ? -0.5 : 0.5));
+    double r = x - k * ln2_hi - k * ln2_lo, term = 1, sum = 1;
+    for (int i = 1; i < 30 && term != 0; i++)
+    {
+        term *= r / i;
+        sum += term;
+    }
+    return scale2(sum, k);
+}
+
+constexpr double log_(double x)
+{
+    if (x != x || x == HUGE_VAL) return x;
+    int k = 0;
+    while (x >= 2) { x *= 0.5; k++; }
+    while (x < 1) { x *= 2; k--; }
+    if (x > 1.4142135623730951) { x *= 0.5; k++; }
+    /* ln(x) = 2 atanh((x - 1) / (x + 1)) */
+    double s = (x - 1) / (x + 1), s2 = s * s, term = s, sum = 0;
+    for (int i = 1; i < 60 && term != 0; i += 2)
+    {
+        sum += term / i;
+        term *= s2;
+    }
+    return 2 * sum + k * ln2_lo + k * ln2_hi;
+}
+
+constexpr double sqrt_(double x)
+{
+    if (x == 0 || x != x || x == HUGE_VAL) return x;
+    int k = 0;
+    while (x >= 4) { x *= 0.25; k++; }
+    while (x < 1) { x *= 4; k--; }
+    double g = x;
+    for (int i = 0; i < 8; i++)
+        g = 0.5 * (g + x / g);
+    return scale2(g, k);
+}
+
+/* Taylor series of sin and cos, for |r| <= pi/4 (or pi after a coarse reduction) */
+constexpr double sin_series(double r)
+{
+    double r2 = r * r, term = r, sum = r;
+    for (int i = 2; i < 60 && term != 0; i += 2)
+    {
+        term *= -r2 / (i * (i + 1));
+        sum += term;
+    }
+    return sum;
+}
+
+constexpr double cos_series(double r)
+{
+    double r2 = r * r, term = 1, sum = 1;
+    for (int i = 1; i < 60 && term != 0; i += 2)
+    {
+        term *= -r2 / (i * (i + 1));
+        sum += term;
+    }
+    return sum;
+}
+
+/*
+ * x = q * pi/2 + r with |r| <= pi/4, q taken mod 4. Reducing by quarter turns
+ * keeps r small, so sin(355) ~ -3e-5 is not the difference of two O(1) series
+ * values. Beyond |x| = 2^31, k * two_pi_1 / 4 stops being exact and whole
+ * turns are removed instead (q = 0, |r| <= pi), accurate in absolute terms.
+ */
+constexpr double reduce(double x, int &q)
+{
+    if (fabs_(x) < 2147483648.0)
+    {
+        double k = floor_(x / (pi / 2) + 0.5);
+        q = static_cast<int>(k - 4 * floor_(k / 4));
+        return ((x - k * (two_pi_1 / 4)) - k * (two_pi_2 / 4)) - k * (two_pi_3 / 4);
+    }
+    double k = floor_(x / (2 * pi) + 0.5);
+    q = -1;
+    return ((x - k * two_pi_1) - k * two_pi_2) - k * two_pi_3;
+}
+
+constexpr double sin_(double x)
+{
+    int q = 0;
+    double r = reduce(x, q);
+    switch (q)
+    {
+        case 1: return cos_series(r);
+        case 2: return -sin_series(r);
+        case 3: return -cos_series(r);
+        default: return sin_series(r);
+    }
+}
+
+constexpr double cos_(double x)
+{
+    int q = 0;
+    double r = reduce(x, q);
+    switch (q)
+    {
+        case 1: return -sin_series(r);
+        case 2: return -cos_series(r);
+        case 3: return sin_series(r);
+        default: return cos_series(r);
+    }
+}
+
+constexpr double tan_(double x)
+{
+    int q = 0;
+    double r = reduce(x, q);
+    if (q < 0)
+        return sin_series(r) / cos_series(r);
+    return (q & 1) ? -cos_series(r) / sin_series(r) : sin_series(r) / cos_series(r);
+}
+
+constexpr double atan_(double x)
+{
+    if (x != x) return x;
+    if (x < 0) return -atan_(-x);
+    if (x > 1) return pi / 2 - atan_(1 / x);
+    /* Two argument halvings bring x below 0.2 before the series */
+    for (int i = 0; i < 2; i++)
+        x = x / (1 + sqrt_(1 + x * x));
+    double x2 = x * x, term = x, sum = 0;
+    for (int i = 1; i < 60 && term != 0; i += 2)
+    {
+        sum += term / i;
+        term *= -x2;
+    }
+    return 4 * sum;
+}
+
+constexpr double asin_(double x)
+{
+    if (x == 1 || x == -1) return x * (pi / 2);
+    return atan_(x / sqrt_(1 - x * x));
+}
+
+constexpr double sinh_(double x)
+{
+    if (fabs_(x) < 0.5)
+    {
+        double x2 = x * x, term = x, sum = x;
+        for (int i = 2; i < 30 && term != 0; i += 2)
+        {
+            term *= x2 / (i * (i + 1));
+            sum += term;
+        }
+        return sum;
+    }
+    return (exp_(x) - exp_(-x)) / 2;
+}
+
+constexpr double tanh_(double x)
+{
+    if (fabs_(x) > 20) return (x < 0) ? -1 : 1;
+    if (fabs_(x) < 0.5) return sinh_(x) / ((exp_(x) + exp_(-x)) / 2);
+    double t = exp_(2 * x);
+    return (t - 1) / (t + 1);
+}
+
+constexpr double pow_(double a, double b)
+{
+    if (b == floor_(b) && fabs_(b) < 2147483648.0)
+    {
+        long long n = static_cast<long long>(b);
+        bool neg = n < 0;
+        double r = 1, base = a;
+        for (n = neg ? -n : n; n; n >>= 1)
+        {
+            if (n & 1) r *= base;
+            base *= base;
+        }
+        if (neg && r == 0)
+            return HUGE_VAL;  /* a constant expression may not divide by zero */
+        return neg ? 1 / r : r;
+    }
+    if (a > 0) return exp_(b * log_(a));
+    if (a == 0) return (b > 0) ? 0.0 : HUGE_VAL;
+    return NAN;
+}
+
+constexpr double fact_(double n)
+{
+    if (n < 0 || n != floor_(n))
+        return -1;
+    double r = 1;
+    for (long i = 2; i <= static_cast<long>(n); i++)
+        r *= i;
+    return r;
+}
+
+/* Library call at run time, series during constant evaluation */
+#define CALC_CX_MATH(name, expr_cx, expr_rt) \
+    constexpr double name(double x) { if (std::is_constant_evaluated()) return expr_cx; return expr_rt; }
+CALC_CX_MATH(m_sqrt, sqrt_(x), std::sqrt(x))
+CALC_CX_MATH(m_sin, sin_(x), std::sin(x))
+CALC_CX_MATH(m_cos, cos_(x), std::cos(x))
+CALC_CX_MATH(m_tan, tan_(x), std::tan(x))
+CALC_CX_MATH(m_asin, asin_(x), std::asin(x))
+CALC_CX_MATH(m_acos, (x == -1) ? pi : 2 * atan_(sqrt_((1 - x) / (1 + x))), std::acos(x))
+CALC_CX_MATH(m_atan, atan_(x), std::atan(x))
+CALC_CX_MATH(m_sinh, sinh_(x), std::sinh(x))
+CALC_CX_MATH(m_cosh, (exp_(x) + exp_(-x)) / 2, std::cosh(x))
+CALC_CX_MATH(m_tanh, tanh_(x), std::tanh(x))
+CALC_CX_MATH(m_log10, log_(x) / (log_(2.0) + log_(5.0)), std::log10(x))
+CALC_CX_MATH(m_ln, log_(x), std::log(x))
+CALC_CX_MATH(m_exp, exp_(x), std::exp(x))
+CALC_CX_MATH(m_floor, floor_(x), std::floor(x))
+CALC_CX_MATH(m_ceil, ceil_(x), std::ceil(x))
+#undef CALC_CX_MATH
+
+constexpr double m_pow(double a, double b)
+{
+    if (std::is_constant_evaluated()) return pow_(a, b);
+    return std::pow(a, b);
+}
+
+constexpr char lower(char c) { return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + 32) : c; }
+
+constexpr bool name_is(std::string_view s, std::string_view name)
+{
+    if (s.size() != name.size())
+        return false;
+    for (std::size_t i = 0; i < s.size(); i++)
+        if (lower(s[i]) != name[i])
+            return false;
+    return true;
+}
+
+} // namespace detail
+
+constexpr bool is_unary(op o) { return o >= op::sqrt && o < op::none; }
+
+/* Operator name (any case) to op, or op::none; "^" and "pow" are both op::pow */
+constexpr op lookup(std::string_view name)
+{
+    constexpr struct { std::string_view name; op id; } names[] =
+    {
+        { "+", op::add }, { "-", op::sub }, { "*", op::mul }, { "/", op::div },
+        { "%", op::mod }, { "^", op::pow }, { "pow", op::pow }, { "p", op::percent },
+        { "//", op::idiv }, { "<", op::lt }, { "<=", op::le }, { ">", op::gt },
+        { ">=", op::ge }, { "==", op::eq }, { "!=", op::ne },
+        { "sqrt", op::sqrt }, { "sin", op::sin }, { "cos", op::cos }, { "tan", op::tan },
+        { "asin", op::asin }, { "acos", op::acos }, { "atan", op::atan },
+        { "sinh", op::sinh }, { "cosh", op::cosh }, { "tanh", op::tanh },
+        { "log", op::log }, { "ln", op::ln }, { "exp", op::exp }, { "abs", op::abs },
+        { "fact", op::fact }, { "floor", op::floor }, { "ceil", op::ceil },
+        { "inv", op::inv }, { "neg", op::neg }, { "pi", op::pi }, { "e", op::e },
+    };
+    for (const auto &n : names)
+        if (detail::name_is(name, n.name))
+            return n.id;
+    return op::none;
+}
+
+/* calc_compute_op(): the same cases, checks and error codes */
+constexpr result compute(double a, double b, op o, context ctx = {})
+{
+    using namespace detail;
+    double ain = ctx.degree_mode ? pi / 180.0 : 1.0;
+    double aout = ctx.degree_mode ? 180.0 / pi : 1.0;
+
+    switch (o)
+    {
+        case op::add:     return { a + b };
+        case op::sub:     return { a - b };
+        case op::mul:     return { a * b };
+        case op::div:     if (b == 0) return { 0, div_by_zero }; return { a / b };
+        case op::mod:
+            if (static_cast<long>(b) == 0) return { 0, div_by_zero };
+            return { static_cast<double>(static_cast<long>(a) % static_cast<long>(b)) };
+        case op::pow:     return { m_pow(a, b) };
+        case op::percent: return { (a / 100.0) * b };
+        case op::idiv:    if (static_cast<long>(b) == 0) return { 0, div_by_zero }; return { m_floor(a / b) };
+        case op::lt:      return { a < b ? 1.0 : 0.0 };
+        case op::le:      return { a <= b ? 1.0 : 0.0 };
+        case op::gt:      return { a > b ? 1.0 : 0.0 };
+        case op::ge:      return { a >= b ? 1.0 : 0.0 };
+        case op::eq:      return { a == b ? 1.0 : 0.0 };
+        case op::ne:      return { a != b ? 1.0 : 0.0 };
+
+        case op::sqrt:    if (a < 0) return { 0, domain_error }; return { m_sqrt(a) };
+        case op::sin:     return { m_sin(a * ain) };
+        case op::cos:     return { m_cos(a * ain) };
+        case op::tan:     return { m_tan(a * ain) };
+        case op::asin:    if (a < -1 || a > 1) return { 0, domain_error }; return { m_asin(a) * aout };
+        case op::acos:    if (a < -1 || a > 1) return { 0, domain_error }; return { m_acos(a) * aout };
+        case op::atan:    return { m_atan(a) * aout };
+        case op::sinh:    return { m_sinh(a) };
+        case op::cosh:    return { m_cosh(a) };
+        case op::tanh:    return { m_tanh(a) };
+        case op::log:     if (a <= 0) return { 0, domain_error }; return { m_log10(a) };
+        case op::ln:      if (a <= 0) return { 0, domain_error }; return { m_ln(a) };
+        case op::exp:     return { m_exp(a) };
+        case op::abs:     return { fabs_(a) };
+        case op::fact:    { double r = fact_(a); if (r < 0) return { 0, domain_error }; return { r }; }
+        case op::floor:   return { m_floor(a) };
+        case op::ceil:    return { m_ceil(a) };
+        case op::inv:     if (a == 0) return { 0, div_by_zero }; return { 1.0 / a };
+        case op::neg:     return { -a };
+        case op::pi:      return { calc::pi };
+        case op::e:       return { calc::e };
+        default:          return { 0, unknown_op };
+    }
+}
+
+/* calc_compute(): "a op b" with the operator given by name */
+constexpr result compute(double a, double b, std::string_view name, context ctx = {})
+{
+    return compute(a, b, lookup(name), ctx);
+}
+
+namespace detail
+{
+
+/*
+ * Recursive descent over the grammar of calc_expr.c, evaluating as it goes.
+ * Syntax errors take precedence over evaluation errors, and the first
+ * evaluation error in left-to-right order wins, as with calc_parse() followed
+ * by calc_eval().
+ */
+class parser
+{
+public:
+    constexpr parser(std::string_view s, std::initializer_list<var> vars, context ctx)
+        : s_(s), vars_(vars), ctx_(ctx) {}
+
+    constexpr result run()
+    {
+        double v = expr();
+        if (!err_ && peek() != '\0')
+            fail(syntax_error);
+        if (err_)
+            return { 0, err_, err_pos_ };
+        if (eval_err_)
+            return { 0, eval_err_ };
+        return { v };
+    }
+
+private:
+    static constexpr int max_depth = 200;
+
+    std::string_view s_;
+    std::initializer_list<var> vars_;
+    context ctx_;
+    std::size_t pos_ = 0;
+    int depth_ = 0;
+    int err_ = ok;
+    std::size_t err_pos_ = 0;
+    int eval_err_ = ok;
+
+    static constexpr bool is_space(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f'; }
+    static constexpr bool is_digit(char c) { return c >= '0' && c <= '9'; }
+    static constexpr bool is_alpha(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_'; }
+
+    constexpr char at(std::size_t i) const { return (i < s_.size()) ? s_[i] : '\0'; }
+
+    constexpr char peek()
+    {
+        while (is_space(at(pos_)))
+            pos_++;
+        return at(pos_);
+    }
+
+    constexpr double fail(int err)
+    {
+        if (!err_)
+        {
+            err_ = err;
+            err_pos_ = pos_;
+        }
+        return 0;
+    }
+
+    constexpr double apply(op o, double a, double b)
+    {
+        if (err_ || eval_err_)
+            return 0;
+        result r = compute(a, b, o, ctx_);
+        eval_err_ = r.err;
+        return r.value;
+    }
+
+    constexpr double number()
+    {
+        std::size_t start = pos_;
+        unsigned long long mant = 0;
+        int exp10 = 0, digits = 0;
+        bool seen = false;
+
+        for (; is_digit(at(pos_)); pos_++, seen = true)
+        {
+            if (digits < 19) { mant = mant * 10 + (at(pos_) - '0'); digits += (mant != 0); }
+            else exp10++;
+        }
+        if (at(pos_) == '.')
+            for (pos_++; is_digit(at(pos_)); pos_++, seen = true)
+                if (digits < 19) { mant = mant * 10 + (at(pos_) - '0'); digits += (mant != 0); exp10--; }
+        if (!seen)
+            return fail(syntax_error);
+        if (lower(at(pos_)) == 'e')
+        {
+            std::size_t p = pos_ + 1;
+            bool neg = at(p) == '-';
+            if (at(p) == '+' || at(p) == '-')
+                p++;
+            if (is_digit(at(p)))
+            {
+                int x = 0;
+                for (; is_digit(at(p)); p++)
+                    x = (x < 10000) ? x * 10 + (at(p) - '0') : x;
+                exp10 += neg ? -x : x;
+                pos_ = p;
+            }
+        }
+
+        if (!std::is_constant_evaluated())
+        {
+            /* strtod for the correctly rounded value (the token is not NUL-terminated) */
+            char buf[64] = {};
+            std::size_t len = pos_ - start;
+            if (len < sizeof(buf))
+            {
+                for (std::size_t i = 0; i < len; i++)
+                    buf[i] = s_[start + i];
+                return std::strtod(buf, nullptr);
+            }
+        }
+        /* Exact when mant < 2^53 and |exp10| <= 22 (Clinger's fast path) */
+        double v = static_cast<double>(mant);
+        for (; exp10 > 22; exp10 -= 22) v *= 1e22;
+        for (; exp10 < -22; exp10 += 22) v /= 1e22;
+        double p10 = 1;
+        for (int i = 0; i < (exp10 < 0 ? -exp10 : exp10); i++)
+            p10 *= 10;
+        return (exp10 < 0) ? v / p10 : v * p10;
+    }
+
+    constexpr double call(std::string_view name, std::size_t name_pos)
+    {
+        op o = lookup(name);
+        if (o == op::none)
+        {
+            pos_ = name_pos;
+            return fail(unknown_op);
+        }
+        pos_++;  /* '(' */
+        if (o == op::pi || o == op::e)
+        {
+            if (peek() != ')')
+                return fail(syntax_error);
+            pos_++;
+            return (o == op::pi) ? calc::pi : calc::e;
+        }
+        double a = expr(), b = 0;
+        if (!is_unary(o))
+        {
+            if (peek() != ',')
+                return fail(syntax_error);
+            pos_++;
+            b = expr();
+        }
+        if (peek() != ')')
+            return fail(syntax_error);
+        pos_++;
+        return apply(o, a, b);
+    }
+
+    constexpr double primary()
+    {
+        char c = peek();
+        if (is_digit(c) || c == '.')
+            return number();
+        if (c == '(')
+        {
+            pos_++;
+            double v = expr();
+            if (peek() != ')')
+                return fail(syntax_error);
+            pos_++;
+            return v;
+        }
+        if (is_alpha(c))
+        {
+            std::size_t start = pos_;
+            while (is_alpha(at(pos_)) || is_digit(at(pos_)))
+                pos_++;
+            std::string_view name = s_.substr(start, pos_ - start);
+            if (peek() == '(')
+                return call(name, start);
+            for (const var &v : vars_)
+                if (v.name == name)
+                    return v.value;
+            op o = lookup(name);
+            if (o == op::pi || o == op::e)
+                return (o == op::pi) ? calc::pi : calc::e;
+            pos_ = start;
+            return fail(unknown_var);
+        }
+        return fail(syntax_error);
+    }
+
+    constexpr double post()
+    {
+        double v = primary();
+        while (!err_ && peek() == '!' && at(pos_ + 1) != '=')
+        {
+            pos_++;
+            v = apply(op::fact, v, 0);
+        }
+        return v;
+    }
+
+    constexpr double power()
+    {
+        double v = post();
+        if (!err_ && peek() == '^')
+        {
+            pos_++;
+            double b = unary();
+            v = apply(op::pow, v, b);
+        }
+        return v;
+    }
+
+    constexpr double unary()
+    {
+        if (++depth_ > max_depth)
+            return fail(syntax_error);
+        double v;
+        char c = peek();
+        if (c == '-' || c == '+')
+        {
+            pos_++;
+            v = unary();
+            if (c == '-')
+                v = apply(op::neg, v, 0);
+        }
+        else
+            v = power();
+        depth_--;
+        return v;
+    }
+
+    constexpr double term()
+    {
+        double v = unary();
+        while (!err_)
+        {
+            char c = peek();
+            op o;
+            if (c == '*')
+                o = op::mul;
+            else if (c == '/' && at(pos_ + 1) == '/')
+            {
+                o = op::idiv;
+                pos_++;
+            }
+            else if (c == '/')
+                o = op::div;
+            else if (c == '%')
+                o = op::mod;
+            else
+                break;
+            pos_++;
+            double b = unary();
+            v = apply(o, v, b);
+        }
+        return v;
+    }
+
+    constexpr double sum()
+    {
+        double v = term();
+        while (!err_)
+        {
+            char c = peek();
+            if (c != '+' && c != '-')
+                break;
+            pos_++;
+            double b = term();
+            v = apply(c == '+' ? op::add : op::sub, v, b);
+        }
+        return v;
+    }
+
+    constexpr double expr()
+    {
+        double v = sum();
+        if (err_)
+            return v;
+        char c = peek(), c2 = at(pos_ + 1);
+        op o;
+        if (c == '<')
+            o = (c2 == '=') ? op::le : op::lt;
+        else if (c == '>')
+            o = (c2 == '=') ? op::ge : op::gt;
+        else if ((c == '=' || c == '!') && c2 == '=')
+            o = (c == '=') ? op::eq : op::ne;
+        else
+            return v;
+        pos_ += (c2 == '=') ? 2 : 1;
+        double b = sum();
+        return apply(o, v, b);
+    }
+};
+
+} // namespace detail
+
+/* calc_parse() + calc_eval() in one pass; variables are looked up by exact name */
+constexpr result eval(std::string_view text, std::initializer_list<var> vars = {}, context ctx = {})
+{
+    return detail::parser(text, vars, ctx).run();
+}
+
+/*
+ * Expression templates: formulas written in C++ whose operators are fixed at
+ * compile time. Calling one evaluates it with arg<N> bound to the Nth
+ * argument; errors propagate exactly as in compute(). Each type records its
+ * arity (highest arg<N> used, plus one), and a call with fewer arguments
+ * does not compile.
+ */
+template <class T>
+concept expression = requires(const T &t, const context &c, const double *v)
+{
+    { t.eval(c, v) } -> std::same_as<result>;
+    { T::arity } -> std::convertible_to<int>;
+};
+
+template <class T>
+concept operand = expression<T> || std::is_arithmetic_v<T>;
+
+template <class D>
+struct callable
+{
+    template <class... T>
+        requires ((std::is_arithmetic_v<T> && ...) && static_cast<int>(sizeof...(T)) >= D::arity)
+    constexpr result operator()(T... xs) const
+    {
+        const double v[sizeof...(T) + 1] = { static_cast<double>(xs)..., 0 };
+        return static_cast<const D &>(*this).eval(context{}, v);
+    }
+
+    template <class... T>
+        requires ((std::is_arithmetic_v<T> && ...) && static_cast<int>(sizeof...(T)) >= D::arity)
+    constexpr result operator()(context ctx, T... xs) const
+    {
+        const double v[sizeof...(T) + 1] = { static_cast<double>(xs)..., 0 };
+        return static_cast<const D &>(*this).eval(ctx, v);
+    }
+};
+
+template <int N>
+    requires (N >= 0)
+struct arg : callable<arg<N>>
+{
+    static constexpr int arity = N + 1;
+    constexpr result eval(const context &, const double *v) const { return { v[N] }; }
+};
+
+struct lit : callable<lit>
+{
+    static constexpr int arity = 0;
+    double v;
+    constexpr lit(double x) : v(x) {}
+    constexpr result eval(const context &, const double *) const { return { v }; }
+};
+
+template <op O, expression A>
+struct unary_expr : callable<unary_expr<O, A>>
+{
+    static constexpr int arity = A::arity;
+    A a;
+    constexpr unary_expr(A x) : a(x) {}
+    constexpr result eval(const context &c, const double *v) const
+    {
+        result x = a.eval(c, v);
+        if (x.err)
+            return x;
+        return compute(x.value, 0, O, c);
+    }
+};
+
+template <op O, expression A, expression B>
+struct binary_expr : callable<binary_expr<O, A, B>>
+{
+    static constexpr int arity = (A::arity > B::arity) ? A::arity : B::arity;
+    A a;
+    B b;
+    constexpr binary_expr(A x, B y) : a(x), b(y) {}
+    constexpr result eval(const context &c, const double *v) const
+    {
+        result x = a.eval(c, v);
+        if (x.err)
+            return x;
+        result y = b.eval(c, v);
+        if (y.err)
+            return y;
+        return compute(x.value, y.value, O, c);
+    }
+};
+
+template <operand T>
+constexpr auto as_expr(const T &t)
+{
+    if constexpr (expression<T>)
+        return t;
+    else
+        return lit(static_cast<double>(t));
+}
+
+template <op O, operand A, operand B>
+    requires (expression<A> || expression<B>)
+constexpr auto make(const A &a, const B &b)
+{
+    return binary_expr<O, decltype(as_expr(a)), decltype(as_expr(b))>(as_expr(a), as_expr(b));
+}
+
+template <operand A, operand B> requires (expression<A> || expression<B>)
+constexpr auto operator+(const A &a, const B &b) { return make<op::add>(a, b); }
+template <operand A, operand B> requires (expression<A> || expression<B>)
+constexpr auto operator-(const A &a, const B &b) { return make<op::sub>(a, b); }
+template <operand A, operand B> requires (expression<A> || expression<B>)
+constexpr auto operator*(const A &a, const B &b) { return make<op::mul>(a, b); }
+template <operand A, operand B> requires (expression<A> || expression<B>)
+constexpr auto operator/(const A &a, const B &b) { return make<op::div>(a, b); }
+template <operand A, operand B> requires (expression<A> || expression<B>)
+constexpr auto operator%(const A &a, const B &b) { return make<op::mod>(a, b); }
+template <expression A>
+constexpr auto operator-(const A &a) { return unary_expr<op::neg, A>(a); }
+
+/* Binary operators without a C++ spelling; pow() doubles as "^" */
+#define CALC_BINARY(name, id) \
+    template <operand A, operand B> constexpr auto name(const A &a, const B &b) \
+    { return binary_expr<id, decltype(as_expr(a)), decltype(as_expr(b))>(as_expr(a), as_expr(b)); }
+CALC_BINARY(pow, op::pow)
+CALC_BINARY(percent, op::percent)
+CALC_BINARY(idiv, op::idiv)
+CALC_BINARY(lt, op::lt)
+CALC_BINARY(le, op::le)
+CALC_BINARY(gt, op::gt)
+CALC_BINARY(ge, op::ge)
+CALC_BINARY(eq, op::eq)
+CALC_BINARY(ne, op::ne)
+#undef CALC_BINARY
+
+/* Unary operators; a plain number argument becomes a literal */
+#define CALC_UNARY(name) \
+    template <operand A> constexpr auto name(const A &a) \
+    { return unary_expr<op::name, decltype(as_expr(a))>(as_expr(a)); }
+CALC_UNARY(sqrt) CALC_UNARY(sin) CALC_UNARY(cos) CALC_UNARY(tan)
+CALC_UNARY(asin) CALC_UNARY(acos) CALC_UNARY(atan) CALC_UNARY(sinh)
+CALC_UNARY(cosh) CALC_UNARY(tanh) CALC_UNARY(log) CALC_UNARY(ln)
+CALC_UNARY(exp) CALC_UNARY(abs) CALC_UNARY(fact) CALC_UNARY(floor)
+CALC_UNARY(ceil) CALC_UNARY(inv) CALC_UNARY(neg)
+#undef CALC_UNARY
+
+} // namespace calc
+
+#endif
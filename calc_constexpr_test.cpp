@@ -0,0 +1,231 @@
+/*
+ * Checks of calc_constexpr.hpp against itself and against the C library
+ * Build: gcc -O2 -c calc.c calc_expr.c calc_prog.c calc_rand.c
+ *        g++ -std=c++20 -O2 calc_constexpr_test.cpp calc.o calc_expr.o calc_prog.o calc_rand.o
+ *            -o calc_constexpr_test -lm
+ * Usage: calc_constexpr_test [--bench]
+ *
+ * Every formula in the tables is evaluated three ways: folded by the
+ * compiler (series math), by calc::eval()/compute() at run time (<cmath>),
+ * and by the C library. Run time must match the C library bit for bit;
+ * compile time must be within MAX_ULPS of run time. --bench also times a
+ * formula as an expression template against calc_run_batch().
+ */
+
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "calc.h"
+#include "calc_constexpr.hpp"
+
+namespace
+{
+
+constexpr long long MAX_ULPS = 4;
+
+int failures = 0;
+
+/* Semantics shared with calc.h, all exact */
+static_assert(calc::compute(7, 2, "//").value == 3 && calc::compute(-7, 2, "//").value == -4);
+static_assert(calc::compute(-7, 3, "%").value == -1 && calc::compute(7.9, 0.5, "%").err == calc::div_by_zero);
+static_assert(calc::compute(50, 8, "p").value == 4);
+static_assert(calc::compute(5, 0, "fact").value == 120 && calc::compute(2.5, 0, "fact").err == calc::domain_error);
+static_assert(calc::compute(1, 0, "/").err == calc::div_by_zero && calc::compute(-1, 0, "sqrt").err == calc::domain_error);
+static_assert(calc::compute(1, 2, "frob").err == calc::unknown_op && calc::compute(2, 10, "POW").value == 1024);
+static_assert(calc::eval("2*3^2 + 4!").value == 42 && calc::eval("-2^2").value == -4);
+static_assert(calc::eval("x^2 - 1 >= 8", { { "x", 3 } }).value == 1);
+static_assert(calc::eval("3 +").err == calc::syntax_error && calc::eval("3 +").err_pos == 3);
+static_assert(calc::eval("y + 1").err == calc::unknown_var && calc::eval("frob(2)").err == calc::unknown_op);
+static_assert(calc::eval("1/0 + (").err == calc::syntax_error && calc::eval("1/0 + 2").err == calc::div_by_zero);
+static_assert(calc::eval("sqrt(16) + ln(1) + floor(-2.5)").value == 1);
+static_assert((calc::sqrt(calc::arg<0>() * calc::arg<0>() + 16) - calc::fact(3))(3.0).value == -1);
+
+/* A call must pass every argument the expression reads */
+using two_args = decltype(calc::arg<0>() + calc::arg<1>());
+static_assert(two_args::arity == 2);
+static_assert(!std::is_invocable_v<two_args, double>);
+static_assert(std::is_invocable_v<two_args, double, double>);
+static_assert(!std::is_invocable_v<decltype(calc::sin(calc::arg<3>())), double>);
+
+constexpr std::string_view formulas[] =
+{
+    "2^0.5", "tan(1.5)", "asin(0.3)", "acos(-0.7)", "atan(12.5)",
+    "sin(355)", "cos(355)", "sin(1e-8)", "cos(0.785)", "tan(-1.2e3)",
+    "sin(123456.789)", "cos(2^30)", "exp(-3.7)", "exp(700)", "ln(12345.678)",
+    "log(0.001234)", "sqrt(2)", "sqrt(1e-300)", "sinh(0.3)", "cosh(-2.5)",
+    "tanh(0.45)", "tanh(3)", "3.7^-2.25", "10^0.301", "asin(-0.999)",
+    "2*sin(0.5)^2 + sqrt(3) - 4!", "exp(ln(7))", "atan(1)*4 - pi",
+};
+
+struct pair_case
+{
+    double a, b;
+    const char *op;
+};
+
+constexpr pair_case pairs[] =
+{
+    { 7, 2, "//" }, { -7, 2, "//" }, { -7, 3, "%" }, { 50, 8, "p" }, { 5, 0, "fact" },
+    { 2.5, 0, "fact" }, { 1, 0, "/" }, { -1, 0, "sqrt" }, { 2, 0.5, "^" }, { 0.3, 0, "asin" },
+    { 1.5, 0, "tan" }, { 355, 0, "sin" }, { 1e-3, 0, "log" }, { 12.5, 0, "ln" }, { -0.7, 0, "acos" },
+    { 0.45, 0, "tanh" }, { 2.5, 0, "cosh" }, { 3, 4, "<=" }, { 3, 3, "!=" }, { -2.5, 0, "floor" },
+};
+
+template <std::size_t... I>
+constexpr auto fold_formulas(std::index_sequence<I...>)
+{
+    return std::array<calc::result, sizeof...(I)>{ calc::eval(formulas[I])... };
+}
+
+template <std::size_t... I>
+constexpr auto fold_pairs(std::index_sequence<I...>)
+{
+    return std::array<calc::result, sizeof...(I)>{ calc::compute(pairs[I].a, pairs[I].b, pairs[I].op)... };
+}
+
+constexpr auto folded = fold_formulas(std::make_index_sequence<std::size(formulas)>{});
+constexpr auto folded_pairs = fold_pairs(std::make_index_sequence<std::size(pairs)>{});
+
+/* Distance in units in the last place, counting across zero */
+long long ulps(double a, double b)
+{
+    if (a == b || (a != a && b != b))
+        return 0;
+    if (a != a || b != b)
+        return -1;
+    auto key = [](double x) {
+        long long i = std::bit_cast<long long>(x);
+        return (i < 0) ? -(i & 0x7fffffffffffffffLL) : i;
+    };
+    long long d = key(a) - key(b);
+    return (d < 0) ? -d : d;
+}
+
+void check_close(const char *what, const calc::result &ct, const calc::result &rt)
+{
+    long long d = ulps(ct.value, rt.value);
+    if (ct.err != rt.err || (rt.err == 0 && (d < 0 || d > MAX_ULPS)))
+    {
+        std::printf("%s: compile time %.17g (err %d), run time %.17g (err %d), %lld ulps\n",
+                    what, ct.value, ct.err, rt.value, rt.err, d);
+        failures++;
+    }
+}
+
+void check_formulas()
+{
+    for (std::size_t i = 0; i < std::size(formulas); i++)
+        check_close(std::string(formulas[i]).c_str(), folded[i], calc::eval(formulas[i]));
+}
+
+void check_pairs()
+{
+    calc_ctx ctx;
+    calc_init(&ctx);
+    for (std::size_t i = 0; i < std::size(pairs); i++)
+    {
+        const pair_case &p = pairs[i];
+        calc::result rt = calc::compute(p.a, p.b, p.op);
+        double c = 0;
+        int err = calc_compute(&ctx, p.a, p.b, p.op, &c);
+        if (err != rt.err || (err == 0 && std::bit_cast<long long>(c) != std::bit_cast<long long>(rt.value)))
+        {
+            std::printf("%g %s %g: run time %.17g (err %d), C library %.17g (err %d)\n",
+                        p.a, p.op, p.b, rt.value, rt.err, c, err);
+            failures++;
+        }
+        char what[64];
+        std::snprintf(what, sizeof(what), "%g %s %g", p.a, p.op, p.b);
+        check_close(what, folded_pairs[i], rt);
+    }
+}
+
+/* The worst distance seen, so a tighter MAX_ULPS can be chosen later */
+void report_worst()
+{
+    long long worst = 0;
+    for (std::size_t i = 0; i < std::size(formulas); i++)
+    {
+        long long d = ulps(folded[i].value, calc::eval(formulas[i]).value);
+        if (d > worst)
+            worst = d;
+    }
+    std::printf("worst compile-time vs run-time distance: %lld ulps (bound %lld)\n", worst, MAX_ULPS);
+}
+
+template <class F>
+double time_ns(F f, long n)
+{
+    auto t = std::chrono::steady_clock::now();
+    f();
+    std::chrono::duration<double, std::nano> d = std::chrono::steady_clock::now() - t;
+    return d.count() / n;
+}
+
+void bench()
+{
+    constexpr long n = 4000000;
+    std::vector<double> x(n), out(n);
+    for (long i = 0; i < n; i++)
+        x[i] = static_cast<double>(i) / n;
+
+    constexpr calc::arg<0> v;
+    constexpr auto f = calc::sqrt(v * v + 1) - v / 3 + calc::pow(v, 2);
+    const char *text = "sqrt(x*x + 1) - x/3 + x^2";
+
+    static char arena_buf[16 * 1024];
+    calc_arena arena;
+    calc_ctx ctx;
+    calc_node *tree;
+    calc_prog prog;
+    size_t pos;
+    calc_init(&ctx);
+    calc_set_var(&ctx, "x", 0);
+    calc_arena_init(&arena, arena_buf, sizeof(arena_buf));
+    if (calc_parse(&ctx, &arena, text, &tree, &pos) != 0 || calc_compile(tree, &prog) != 0)
+        return;
+    int var = calc_var_index(&ctx, "x");
+
+    double sum_et = 0, sum_batch = 0;
+    double et = time_ns([&] { for (long i = 0; i < n; i++) sum_et += f(x[i]).value; }, n);
+    double batch = time_ns([&] {
+        calc_run_batch(&ctx, &prog, var, x.data(), out.data(), n);
+        for (long i = 0; i < n; i++)
+            sum_batch += out[i];
+    }, n);
+    double walk = time_ns([&] {
+        double r;
+        for (long i = 0; i < n; i++)
+        {
+            ctx.var_values[var] = x[i];
+            calc_eval(&ctx, tree, &r);
+        }
+    }, n);
+    std::printf("%s over %ld values, ns per value:\n", text, n);
+    std::printf("  expression template %.1f, calc_run_batch %.1f, calc_eval %.1f%s\n", et, batch, walk,
+                (sum_et == sum_batch) ? "" : "  (sums differ)");
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    check_formulas();
+    check_pairs();
+    report_worst();
+    if (argc > 1 && std::string_view(argv[1]) == "--bench")
+        bench();
+    if (failures)
+        std::printf("%d check(s) failed\n", failures);
+    else
+        std::printf("all checks passed\n");
+    return failures ? 1 : 0;
+}
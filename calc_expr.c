@@ -0,0 +1,395 @@
+/*
+ * Calculator engine - infix expression parser and evaluator, see calc.h
+ * Grammar (lowest to highest precedence):
+ *   expr  := sum (('<' | '<=' | '>' | '>=' | '==' | '!=') sum)?   1 if true, else 0
+ *   sum   := term (('+' | '-') term)*
+ *   term  := unary (('*' | '/' | '//' | '%') unary)*
+ *   unary := ('-' | '+') unary | power
+ *   power := post ('^' unary)?           right associative, -2^2 = -4
+ *   post  := primary '!'*                n! is fact(n)
+ *   primary := number 'i'? | name | name '(' expr (',' expr)? ')' | '(' expr ')'
+ *            | 'rand' '(' ')' | 'randn' '(' ')'
+ * "2i" is an imaginary literal, and so is a bare "i" unless a variable has that name.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "calc.h"
+
+#define ARENA_ALIGN 16
+#define MAX_DEPTH   200  /* nesting limit so hostile input cannot exhaust the stack */
+
+typedef struct parser
+{
+    const calc_ctx *ctx;
+    calc_arena *arena;
+    const char *s;
+    size_t pos;
+    int depth;
+    int streams;  /* rand()/randn() calls seen so far; each gets its own stream */
+    int err;
+    size_t err_pos;
+} parser;
+
+void calc_arena_init(calc_arena *arena, void *buf, size_t size)
+{
+    arena->base = buf;
+    arena->size = size;
+    arena->used = 0;
+}
+
+void calc_arena_reset(calc_arena *arena)
+{
+    arena->used = 0;
+}
+
+void *calc_arena_alloc(calc_arena *arena, size_t size)
+{
+    size_t start = (arena->used + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (start > arena->size || size > arena->size - start)
+        return NULL;
+    arena->used = start + size;
+    return arena->base + start;
+}
+
+static int is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static int is_digit(char c) { return c >= '0' && c <= '9'; }
+static int is_alpha(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_'; }
+
+/* Skips whitespace and returns the next character without consuming it */
+static char peek(parser *p)
+{
+    while (is_space(p->s[p->pos]))
+        p->pos++;
+    return p->s[p->pos];
+}
+
+static calc_node *fail(parser *p, int err)
+{
+    if (!p->err)
+    {
+        p->err = err;
+        p->err_pos = p->pos;
+    }
+    return NULL;
+}
+
+static calc_node *new_node(parser *p, int kind)
+{
+    calc_node *n = calc_arena_alloc(p->arena, sizeof(*n));
+    if (!n)
+        return fail(p, 4);
+    memset(n, 0, sizeof(*n));
+    n->kind = kind;
+    return n;
+}
+
+static calc_node *new_op(parser *p, int op, calc_node *a, calc_node *b)
+{
+    if (!a || (!b && !calc_op_is_unary(op)))
+        return NULL;
+    calc_node *n = new_node(p, CALC_NODE_OP);
+    if (n)
+    {
+        n->op = op;
+        n->a = a;
+        n->b = b;
+    }
+    return n;
+}
+
+static calc_node *new_num(parser *p, double v)
+{
+    calc_node *n = new_node(p, CALC_NODE_NUM);
+    if (n)
+        n->num = v;
+    return n;
+}
+
+static calc_node *parse_expr(parser *p);
+static calc_node *parse_unary(parser *p);
+
+static calc_node *parse_call(parser *p, const char *name, size_t name_pos)
+{
+    if (strcmp(name, "rand") == 0 || strcmp(name, "randn") == 0)
+    {
+        p->pos++;  /* '(' */
+        if (peek(p) != ')')
+            return fail(p, 2);
+        p->pos++;
+        calc_node *n = new_node(p, CALC_NODE_RAND);
+        if (n)
+        {
+            n->op = (name[4] == 'n') ? CALC_RAND_NORMAL : CALC_RAND_UNIFORM;
+            n->var = p->streams++;
+        }
+        return n;
+    }
+
+    int op = calc_op_lookup(name);
+    if (op < 0 || op > CALC_OP_ARG)
+    {
+        p->pos = name_pos;
+        return fail(p, 1);
+    }
+    p->pos++;  /* '(' */
+
+    if (op == CALC_OP_PI || op == CALC_OP_E)
+    {
+        if (peek(p) != ')')
+            return fail(p, 2);
+        p->pos++;
+        return new_num(p, op == CALC_OP_PI ? CALC_PI : CALC_E);
+    }
+
+    calc_node *a = parse_expr(p), *b = NULL;
+    if (!calc_op_is_unary(op))
+    {
+        if (peek(p) != ',')
+            return fail(p, 2);
+        p->pos++;
+        b = parse_expr(p);
+    }
+    if (peek(p) != ')')
+        return fail(p, 2);
+    p->pos++;
+    return new_op(p, op, a, b);
+}
+
+static calc_node *parse_primary(parser *p)
+{
+    char c = peek(p);
+
+    if (is_digit(c) || c == '.')
+    {
+        char *end;
+        double v = strtod(p->s + p->pos, &end);
+        if (end == p->s + p->pos)
+            return fail(p, 2);
+        p->pos = (size_t)(end - p->s);
+        if (p->s[p->pos] == 'i' && !is_alpha(p->s[p->pos + 1]) && !is_digit(p->s[p->pos + 1]))
+        {
+            p->pos++;
+            return new_op(p, CALC_OP_MUL_I, new_num(p, v), NULL);
+        }
+        return new_num(p, v);
+    }
+
+    if (c == '(')
+    {
+        p->pos++;
+        calc_node *n = parse_expr(p);
+        if (peek(p) != ')')
+            return fail(p, 2);
+        p->pos++;
+        return n;
+    }
+
+    if (is_alpha(c))
+    {
+        char name[CALC_MAX_NAME];
+        size_t start = p->pos, len = 0;
+        while (is_alpha(p->s[p->pos]) || is_digit(p->s[p->pos]))
+        {
+            /* Truncating would make two long names share one variable slot */
+            if (len == CALC_MAX_NAME - 1)
+            {
+                p->pos = start;
+                return fail(p, 2);
+            }
+            name[len++] = p->s[p->pos++];
+        }
+        name[len] = '\0';
+
+        if (peek(p) == '(')
+            return parse_call(p, name, start);
+
+        int var = calc_var_index(p->ctx, name);
+        if (var >= 0)
+        {
+            calc_node *n = new_node(p, CALC_NODE_VAR);
+            if (n)
+                n->var = var;
+            return n;
+        }
+        int op = calc_op_lookup(name);
+        if (op == CALC_OP_PI || op == CALC_OP_E)
+            return new_num(p, op == CALC_OP_PI ? CALC_PI : CALC_E);
+        if (strcmp(name, "i") == 0)
+            return new_op(p, CALC_OP_MUL_I, new_num(p, 1), NULL);
+        p->pos = start;
+        return fail(p, 3);
+    }
+
+    return fail(p, 2);
+}
+
+static calc_node *parse_post(parser *p)
+{
+    calc_node *n = parse_primary(p);
+    while (n && peek(p) == '!' && p->s[p->pos + 1] != '=')
+    {
+        p->pos++;
+        n = new_op(p, CALC_OP_FACT, n, NULL);
+    }
+    return n;
+}
+
+static calc_node *parse_power(parser *p)
+{
+    calc_node *n = parse_post(p);
+    if (n && peek(p) == '^')
+    {
+        p->pos++;
+        n = new_op(p, CALC_OP_POW, n, parse_unary(p));
+    }
+    return n;
+}
+
+static calc_node *parse_unary(parser *p)
+{
+    calc_node *n;
+    char c = peek(p);
+
+    if (++p->depth > MAX_DEPTH)
+        return fail(p, 2);
+    if (c == '-')
+    {
+        p->pos++;
+        n = new_op(p, CALC_OP_NEG, parse_unary(p), NULL);
+    }
+    else if (c == '+')
+    {
+        p->pos++;
+        n = parse_unary(p);
+    }
+    else
+        n = parse_power(p);
+    p->depth--;
+    return n;
+}
+
+static calc_node *parse_term(parser *p)
+{
+    calc_node *n = parse_unary(p);
+    while (n)
+    {
+        char c = peek(p);
+        int op;
+        if (c == '*')
+            op = CALC_OP_MUL;
+        else if (c == '/' && p->s[p->pos + 1] == '/')
+        {
+            op = CALC_OP_IDIV;
+            p->pos++;
+        }
+        else if (c == '/')
+            op = CALC_OP_DIV;
+        else if (c == '%')
+            op = CALC_OP_MOD;
+        else
+            break;
+        p->pos++;
+        n = new_op(p, op, n, parse_unary(p));
+    }
+    return n;
+}
+
+static calc_node *parse_sum(parser *p)
+{
+    calc_node *n = parse_term(p);
+    while (n)
+    {
+        char c = peek(p);
+        if (c != '+' && c != '-')
+            break;
+        p->pos++;
+        n = new_op(p, c == '+' ? CALC_OP_ADD : CALC_OP_SUB, n, parse_term(p));
+    }
+    return n;
+}
+
+/* Comparisons do not chain: "a < b < c" is a syntax error */
+static calc_node *parse_expr(parser *p)
+{
+    calc_node *n = parse_sum(p);
+    if (!n)
+        return n;
+
+    /* The character after c is only read once c is known not to be the terminator */
+    char c = peek(p);
+    int op, eq;
+    if (c == '<' || c == '>')
+    {
+        eq = p->s[p->pos + 1] == '=';
+        op = (c == '<') ? (eq ? CALC_OP_LE : CALC_OP_LT) : (eq ? CALC_OP_GE : CALC_OP_GT);
+    }
+    else if ((c == '=' || c == '!') && p->s[p->pos + 1] == '=')
+    {
+        eq = 1;
+        op = (c == '=') ? CALC_OP_EQ : CALC_OP_NE;
+    }
+    else
+        return n;
+    p->pos += eq ? 2 : 1;
+    return new_op(p, op, n, parse_sum(p));
+}
+
+int calc_parse(const calc_ctx *ctx, calc_arena *arena, const char *text, calc_node **out, size_t *err_pos)
+{
+    parser p = { ctx, arena, text, 0, 0, 0, 0, 0 };
+    calc_node *n = parse_expr(&p);
+
+    if (n && peek(&p) != '\0')
+        fail(&p, 2);
+    if (p.err)
+    {
+        if (err_pos)
+            *err_pos = p.err_pos;
+        return p.err;
+    }
+    *out = n;
+    return 0;
+}
+
+int calc_eval(const calc_ctx *ctx, const calc_node *node, double *result)
+{
+    double a, b = 0;
+    int err;
+
+    switch (node->kind)
+    {
+        case CALC_NODE_NUM: *result = node->num; return 0;
+        case CALC_NODE_VAR: *result = ctx->var_values[node->var]; return 0;
+        case CALC_NODE_RAND: *result = calc_rand_node(ctx, node->op, node->var, ctx->rng_counter); return 0;
+        default: break;
+    }
+    if ((err = calc_eval(ctx, node->a, &a)) != 0)
+        return err;
+    if (node->b && (err = calc_eval(ctx, node->b, &b)) != 0)
+        return err;
+    return calc_compute_op(ctx, a, b, node->op, result);
+}
+
+int calc_eval_complex(const calc_ctx *ctx, const calc_node *node, double complex *result)
+{
+    double complex a, b = 0;
+    int err;
+
+    switch (node->kind)
+    {
+        case CALC_NODE_NUM: *result = node->num; return 0;
+        case CALC_NODE_VAR: *result = ctx->var_values[node->var]; return 0;
+        case CALC_NODE_RAND: *result = calc_rand_node(ctx, node->op, node->var, ctx->rng_counter); return 0;
+        default: break;
+    }
+    if ((err = calc_eval_complex(ctx, node->a, &a)) != 0)
+        return err;
+    if (node->b && (err = calc_eval_complex(ctx, node->b, &b)) != 0)
+        return err;
+    return calc_compute_complex_op(ctx, a, b, node->op, result);
+}
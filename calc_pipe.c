@@ -0,0 +1,278 @@
+/*
+ * Calculator engine - map/filter/reduce pipelines over number streams, see calc.h
+ */
+
+#include <math.h>
+#include <string.h>
+#include "calc.h"
+
+#define PIPE_TEXT    1024   /* longest stage formula */
+#define PIPE_BLOCKS  64     /* parallel split of one calc_pipe_push() */
+
+/* Running state of one range: a partial reduction or a count of kept values */
+typedef struct part
+{
+    double acc, comp;
+    unsigned long long count;
+    int status;
+    size_t kept;
+} part;
+
+/* Neumaier's improved Kahan summation: *sum + *comp carries the running total */
+static void neumaier_add(double *sum, double *comp, double x)
+{
+    double t = *sum + x;
+    if (fabs(*sum) >= fabs(x))
+        *comp += (*sum - t) + x;
+    else
+        *comp += (x - t) + *sum;
+    *sum = t;
+}
+
+static int is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+/* Parses one "map f", "filter f" or "reduce op" stage held in text */
+static int parse_stage(const calc_ctx *ctx, calc_arena *arena, const char *text, calc_pipe *pipe,
+                       size_t *err_pos)
+{
+    size_t pos = strspn(text, " \t\r\n"), len = pos;
+    while (text[len] && !is_space(text[len]))
+        len++;
+    const char *word = text + pos;
+    size_t wlen = len - pos;
+
+    *err_pos = pos;
+    if (wlen == 0 || pipe->reduce >= 0)
+        return 2;  /* empty stage, or a stage after reduce */
+
+    if (wlen == 6 && strncmp(word, "reduce", 6) == 0)
+    {
+        char op[CALC_MAX_OP];
+        size_t start = len + strspn(text + len, " \t\r\n"), end = start;
+        while (text[end] && !is_space(text[end]))
+            end++;
+        *err_pos = start;
+        if (end == start || end - start >= CALC_MAX_OP || text[end + strspn(text + end, " \t\r\n")] != '\0')
+            return 2;
+        memcpy(op, text + start, end - start);
+        op[end - start] = '\0';
+        int id = calc_op_lookup(op);
+        if (id < 0 || calc_op_is_unary(id))
+            return 1;
+        pipe->reduce = id;
+        return 0;
+    }
+
+    int kind;
+    if (wlen == 3 && strncmp(word, "map", 3) == 0)
+        kind = CALC_STAGE_MAP;
+    else if (wlen == 6 && strncmp(word, "filter", 6) == 0)
+        kind = CALC_STAGE_FILTER;
+    else
+        return 1;
+    if (pipe->stages == CALC_PIPE_STAGES)
+        return 4;
+
+    calc_node *tree;
+    size_t at = 0;
+    calc_arena_reset(arena);
+    int err = calc_parse(ctx, arena, text + len, &tree, &at);
+    *err_pos = len + at;
+    if (err != 0)
+        return err;
+    calc_stage *st = &pipe->stage[pipe->stages];
+    if (calc_compile(tree, &st->prog) != 0)
+        return 4;
+    st->kind = kind;
+    pipe->stages++;
+    return 0;
+}
+
+int calc_pipe_parse(const calc_ctx *ctx, calc_arena *arena, const char *text, int var,
+                    calc_pipe *pipe, size_t *err_pos)
+{
+    char seg[PIPE_TEXT];
+    size_t start = 0;
+
+    pipe->stages = 0;
+    pipe->var = var;
+    pipe->reduce = -1;
+
+    for (;;)
+    {
+        size_t len = strcspn(text + start, "|"), pos = 0;
+        if (len >= sizeof(seg))
+        {
+            if (err_pos)
+                *err_pos = start + sizeof(seg) - 1;
+            return 4;
+        }
+        memcpy(seg, text + start, len);
+        seg[len] = '\0';
+        int err = parse_stage(ctx, arena, seg, pipe, &pos);
+        if (err != 0)
+        {
+            if (err_pos)
+                *err_pos = start + pos;
+            return err;
+        }
+        if (text[start + len] == '\0')
+        {
+            calc_pipe_reset(pipe);
+            return 0;
+        }
+        start += len + 1;
+    }
+}
+
+void calc_pipe_reset(calc_pipe *pipe)
+{
+    pipe->acc = (pipe->reduce == CALC_OP_MUL) ? 1 : 0;
+    pipe->comp = 0;
+    pipe->count = 0;
+    pipe->status = 0;
+}
+
+/* Runs the map and filter stages over one chunk in place; returns how many values survive */
+static int run_stages(const calc_ctx *ctx, const calc_pipe *pipe, double *v, int n)
+{
+    double keep[CALC_PIPE_CHUNK];
+
+    for (int s = 0; s < pipe->stages && n > 0; s++)
+    {
+        const calc_stage *st = &pipe->stage[s];
+        if (st->kind == CALC_STAGE_MAP)
+        {
+            calc_run_batch(ctx, &st->prog, pipe->var, v, v, n);
+            continue;
+        }
+        calc_run_batch(ctx, &st->prog, pipe->var, v, keep, n);
+        int m = 0;
+        for (int i = 0; i < n; i++)
+        {
+            v[m] = v[i];
+            m += (keep[i] != 0 && keep[i] == keep[i]);  /* NaN counts as false */
+        }
+        n = m;
+    }
+    return n;
+}
+
+static void fold(const calc_ctx *ctx, int op, const double *v, int n, part *r)
+{
+    if (op == CALC_OP_ADD)
+    {
+        for (int i = 0; i < n; i++)
+            neumaier_add(&r->acc, &r->comp, v[i]);
+    }
+    else if (op == CALC_OP_MUL)
+    {
+        for (int i = 0; i < n; i++)
+            r->acc *= v[i];
+    }
+    else
+    {
+        for (int i = 0; i < n && r->status == 0; i++)
+        {
+            if (r->count == 0 && i == 0)
+                r->acc = v[i];
+            else
+                r->status = calc_compute_op(ctx, r->acc, v[i], op, &r->acc);
+        }
+    }
+    r->count += (unsigned long long)n;
+}
+
+/* Streams x[first..last) through the stages; kept values go to out[first..] */
+static void run_range(const calc_ctx *ctx, const calc_pipe *pipe, const double *x, double *out,
+                      size_t first, size_t last, part *r)
+{
+    double v[CALC_PIPE_CHUNK];
+    calc_ctx c = *ctx;
+
+    for (size_t i = first; i < last; i += CALC_PIPE_CHUNK)
+    {
+        int n = (last - i < CALC_PIPE_CHUNK) ? (int)(last - i) : CALC_PIPE_CHUNK;
+        memcpy(v, x + i, n * sizeof(double));
+        c.rng_counter = ctx->rng_counter + i;
+        n = run_stages(&c, pipe, v, n);
+        if (pipe->reduce < 0)
+        {
+            /* Never passes the read position, so out may be x */
+            memcpy(out + first + r->kept, v, n * sizeof(double));
+            r->kept += n;
+        }
+        else
+            fold(&c, pipe->reduce, v, n, r);
+    }
+}
+
+size_t calc_pipe_push(const calc_ctx *ctx, calc_pipe *pipe, const double *x, size_t n, double *out)
+{
+    part parts[PIPE_BLOCKS];
+    int op = pipe->reduce;
+
+    /* Left folds of other operators depend on order, so they stay on one thread */
+    if ((op >= 0 && op != CALC_OP_ADD && op != CALC_OP_MUL) || n < PIPE_BLOCKS * CALC_PIPE_CHUNK)
+    {
+        part r = { pipe->acc, pipe->comp, pipe->count, pipe->status, 0 };
+        run_range(ctx, pipe, x, out, 0, n, &r);
+        pipe->acc = r.acc;
+        pipe->comp = r.comp;
+        pipe->count = r.count;
+        pipe->status = r.status;
+        return r.kept;
+    }
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic, 1)
+#endif
+    for (int blk = 0; blk < PIPE_BLOCKS; blk++)
+    {
+        size_t first = n / PIPE_BLOCKS * blk, last = (blk == PIPE_BLOCKS - 1) ? n : first + n / PIPE_BLOCKS;
+        part *r = &parts[blk];
+        r->acc = (op == CALC_OP_MUL) ? 1 : 0;
+        r->comp = 0;
+        r->count = 0;
+        r->status = 0;
+        r->kept = 0;
+        run_range(ctx, pipe, x, out, first, last, r);
+    }
+
+    /* Combined in block order, so results do not depend on the thread count */
+    size_t kept = 0;
+    for (int blk = 0; blk < PIPE_BLOCKS; blk++)
+    {
+        const part *r = &parts[blk];
+        if (op < 0)
+        {
+            memmove(out + kept, out + n / PIPE_BLOCKS * blk, r->kept * sizeof(double));
+            kept += r->kept;
+            continue;
+        }
+        if (op == CALC_OP_MUL)
+            pipe->acc *= r->acc;
+        else
+        {
+            neumaier_add(&pipe->acc, &pipe->comp, r->acc);
+            pipe->comp += r->comp;
+        }
+        pipe->count += r->count;
+    }
+    return kept;
+}
+
+int calc_pipe_result(const calc_pipe *pipe, double *result)
+{
+    if (pipe->reduce < 0)
+        return 1;
+    if (pipe->status != 0)
+        return pipe->status;
+    if (pipe->count == 0 && pipe->reduce != CALC_OP_ADD && pipe->reduce != CALC_OP_MUL)
+        return -2;
+    *result = pipe->acc + pipe->comp;
+    return 0;
+}
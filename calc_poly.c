@@ -0,0 +1,346 @@
+/*
+ * Calculator engine - polynomials: column evaluation, products and roots, see calc.h
+ */
+
+#include <math.h>
+#include <float.h>
+#include <string.h>
+#include "calc.h"
+
+#define POLY_LANES     64     /* inputs advanced together through one Horner step */
+#define POLY_FFT_MIN   256    /* smaller factor degree from which products use the FFT (calc_bench poly) */
+#define POLY_FFT_SIZE  (2 * CALC_POLY_MAX_DEGREE)
+#define POLY_MAX_ITER  500
+#define POLY_PARALLEL  64     /* root count from which Aberth steps run in parallel */
+
+int calc_poly_set(calc_poly *p, const double *c, int n)
+{
+    while (n > 1 && c[n - 1] == 0)
+        n--;
+    if (n - 1 > CALC_POLY_MAX_DEGREE)
+        return 4;
+    if (n < 1)
+    {
+        p->degree = 0;
+        p->c[0] = 0;
+        return 0;
+    }
+    p->degree = n - 1;
+    memcpy(p->c, c, n * sizeof(double));
+    return 0;
+}
+
+double calc_poly_eval(const calc_poly *p, double x)
+{
+    double y = p->c[p->degree];
+    for (int i = p->degree - 1; i >= 0; i--)
+        y = y * x + p->c[i];
+    return y;
+}
+
+/*
+ * Horner across POLY_LANES inputs at once: each coefficient is one pass over
+ * independent lanes, which the compiler turns into vector multiply-adds, and
+ * every lane rounds exactly like calc_poly_eval().
+ */
+static void eval_lanes(const calc_poly *p, const double *x, double *out, int lanes)
+{
+    double xs[POLY_LANES], y[POLY_LANES];
+
+    memcpy(xs, x, lanes * sizeof(double));
+    for (int l = lanes; l < POLY_LANES; l++)
+        xs[l] = 0;
+    for (int l = 0; l < POLY_LANES; l++)
+        y[l] = p->c[p->degree];
+    for (int i = p->degree - 1; i >= 0; i--)
+    {
+        double c = p->c[i];
+        for (int l = 0; l < POLY_LANES; l++)
+            y[l] = y[l] * xs[l] + c;
+    }
+    memcpy(out, y, lanes * sizeof(double));
+}
+
+void calc_poly_eval_column(const calc_poly *p, const double *x, double *out, size_t n)
+{
+    long blocks = (long)((n + POLY_LANES - 1) / POLY_LANES);
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic, 16)
+#endif
+    for (long b = 0; b < blocks; b++)
+    {
+        size_t i = (size_t)b * POLY_LANES;
+        int lanes = (n - i < POLY_LANES) ? (int)(n - i) : POLY_LANES;
+        eval_lanes(p, x + i, out + i, lanes);
+    }
+}
+
+void calc_poly_deriv(const calc_poly *p, calc_poly *out)
+{
+    int n = p->degree;
+
+    if (n == 0)
+    {
+        out->degree = 0;
+        out->c[0] = 0;
+        return;
+    }
+    for (int i = 1; i <= n; i++)
+        out->c[i - 1] = i * p->c[i];
+    out->degree = n - 1;
+}
+
+/*
+ * Complex product written out: C99's a * b goes through __muldc3 for its
+ * infinity and NaN rules, which is several times slower in the FFT loops.
+ */
+static double complex cmul(double complex a, double complex b)
+{
+    double ar = creal(a), ai = cimag(a), br = creal(b), bi = cimag(b);
+    return (ar * br - ai * bi) + I * (ar * bi + ai * br);
+}
+
+/*
+ * w[k] = exp(-2 pi i k / n) for k < n/2, from cos/sin directly rather than by
+ * recurrence, which drifts at large n. The second quarter is the first turned
+ * by -pi/2, so only n/4 angles are computed.
+ */
+static void twiddles(double complex *w, int n)
+{
+    w[0] = 1;
+    for (int k = 0; k < n / 4; k++)
+    {
+        double ang = -2 * CALC_PI * k / n;
+        w[k] = cos(ang) + I * sin(ang);
+        w[k + n / 4] = cimag(w[k]) - I * creal(w[k]);
+    }
+}
+
+/* In-place radix-2 FFT of length n (a power of two) with twiddles w; inverse is unscaled */
+static void fft(double complex *z, int n, const double complex *w, int inverse)
+{
+    for (int i = 1, j = 0; i < n; i++)
+    {
+        int bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+        if (i < j)
+        {
+            double complex t = z[i];
+            z[i] = z[j];
+            z[j] = t;
+        }
+    }
+    for (int len = 2; len <= n; len <<= 1)
+    {
+        int half = len / 2, stride = n / len;
+        for (int k = 0; k < half; k++)
+        {
+            /* The table is for length n; stage len uses every (n / len)-th entry */
+            double complex wk = inverse ? conj(w[k * stride]) : w[k * stride];
+            for (int i = k; i < n; i += len)
+            {
+                double complex u = z[i], v = cmul(z[i + half], wk);
+                z[i] = u + v;
+                z[i + half] = u - v;
+            }
+        }
+    }
+}
+
+/*
+ * Both real factors share one complex transform (a in the real part, b in
+ * the imaginary part); their spectra are separated with the conjugate
+ * symmetry of real inputs, multiplied, and transformed back.
+ */
+static void mul_fft(const calc_poly *a, const calc_poly *b, calc_poly *out)
+{
+    double complex z[POLY_FFT_SIZE], prod[POLY_FFT_SIZE], w[POLY_FFT_SIZE / 2];
+    int deg = a->degree + b->degree, n = 1;
+
+    while (n <= deg)
+        n <<= 1;
+    twiddles(w, n);
+    for (int i = 0; i < n; i++)
+        z[i] = ((i <= a->degree) ? a->c[i] : 0) + I * ((i <= b->degree) ? b->c[i] : 0);
+    fft(z, n, w, 0);
+    for (int k = 0; k < n; k++)
+    {
+        double complex zk = z[k], zn = conj(z[(n - k) & (n - 1)]);
+        double complex fa = (zk + zn) / 2, d = zk - zn;
+        double complex fb = (cimag(d) - I * creal(d)) / 2;  /* d / 2i */
+        prod[k] = cmul(fa, fb);
+    }
+    fft(prod, n, w, 1);
+    for (int i = 0; i <= deg; i++)
+        out->c[i] = creal(prod[i]) / n;
+    out->degree = deg;
+}
+
+int calc_poly_mul(const calc_poly *a, const calc_poly *b, calc_poly *out)
+{
+    int deg = a->degree + b->degree;
+    int small = (a->degree < b->degree) ? a->degree : b->degree;
+
+    if (deg > CALC_POLY_MAX_DEGREE)
+        return 4;
+    if (small >= POLY_FFT_MIN)
+    {
+        mul_fft(a, b, out);
+        return 0;
+    }
+
+    /* Direct convolution; out may alias a or b, so it is built in a copy */
+    calc_poly r;
+    for (int i = 0; i <= deg; i++)
+        r.c[i] = 0;
+    for (int i = 0; i <= a->degree; i++)
+        for (int j = 0; j <= b->degree; j++)
+            r.c[i + j] += a->c[i] * b->c[j];
+    r.degree = deg;
+    memcpy(out->c, r.c, (deg + 1) * sizeof(double));
+    out->degree = deg;
+    return 0;
+}
+
+/*
+ * Newton quotient p(z) / p'(z) as num / den, with err a rounding error bound
+ * for num. Outside the unit disc the reversed polynomial is evaluated at 1/z
+ * (p(z) = z^n q(1/z)), so high degrees never overflow; num, den and err are
+ * then all scaled by z^(1-n).
+ */
+static void newton_quotient(const double *c, int n, double complex z,
+                            double complex *num, double complex *den, double *err)
+{
+    double az = cabs(z);
+
+    if (az <= 1)
+    {
+        double complex p = c[n], d = 0;
+        double e = cabs(p) / 2;
+        for (int i = n - 1; i >= 0; i--)
+        {
+            d = d * z + p;
+            p = p * z + c[i];
+            e = e * az + cabs(p);
+        }
+        *num = p;
+        *den = d;
+        *err = 4 * DBL_EPSILON * e;
+        return;
+    }
+
+    double complex w = 1 / z, q = c[0], dq = 0;
+    double e = cabs(q) / 2, aw = 1 / az;
+    for (int i = 1; i <= n; i++)
+    {
+        dq = dq * w + q;
+        q = q * w + c[i];
+        e = e * aw + cabs(q);
+    }
+    *num = z * q;
+    *den = n * q - w * dq;
+    *err = 4 * DBL_EPSILON * e * az;
+}
+
+/*
+ * Aberth-Ehrlich iteration on c[0..n] (c[0] and c[n] nonzero). Every step
+ * updates all unconverged roots from the previous estimates (Jacobi order),
+ * so the parallel loop gives the same roots for any thread count. A root has
+ * converged when |p(z)| is within its rounding error bound.
+ */
+static int aberth(const double *c, int n, double complex *z)
+{
+    double complex next[CALC_POLY_MAX_DEGREE];
+    char done[CALC_POLY_MAX_DEGREE];
+
+    /* Start on a circle whose radius is the geometric mean of the root moduli */
+    double r = pow(fabs(c[0] / c[n]), 1.0 / n);
+    for (int k = 0; k < n; k++)
+    {
+        double ang = 2 * CALC_PI * k / n + 0.4;
+        z[k] = r * (cos(ang) + I * sin(ang));
+        done[k] = 0;
+    }
+
+    for (int iter = 0; iter < POLY_MAX_ITER; iter++)
+    {
+        int active = 0;
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(dynamic, 16) reduction(+:active) if (n >= POLY_PARALLEL)
+#endif
+        for (int k = 0; k < n; k++)
+        {
+            next[k] = z[k];
+            if (done[k])
+                continue;
+
+            double complex num, den, sum = 0;
+            double err;
+            newton_quotient(c, n, z[k], &num, &den, &err);
+            if (cabs(num) <= err)
+            {
+                done[k] = 1;
+                continue;
+            }
+            for (int j = 0; j < n; j++)
+                if (j != k)
+                    sum += 1 / (z[k] - z[j]);
+
+            double complex d = den - num * sum;
+            if (d == 0)
+                d = DBL_EPSILON * (1 + cabs(den));  /* a stationary point: nudge off it */
+            double complex step = num / d;
+            next[k] = z[k] - step;
+            if (cabs(step) <= DBL_EPSILON * cabs(next[k]))
+                done[k] = 1;
+            else
+                active++;
+        }
+        memcpy(z, next, n * sizeof(double complex));
+        if (active == 0)
+            return 0;
+    }
+    return 5;
+}
+
+int calc_poly_roots(const calc_poly *p, double complex *roots)
+{
+    int n = p->degree, zeros = 0;
+
+    if (p->c[n] == 0)
+        return -2;  /* the zero polynomial, or a degree that calc_poly_set() would have trimmed */
+
+    /* Roots at zero are exact; divide them out first */
+    while (zeros < n && p->c[zeros] == 0)
+        roots[zeros++] = 0;
+    const double *c = p->c + zeros;
+    int m = n - zeros;
+    double complex *z = roots + zeros;
+
+    if (m == 0)
+        return 0;
+    if (m == 1)
+    {
+        z[0] = -c[0] / c[1];
+        return 0;
+    }
+
+    int err = aberth(c, m, z);
+
+    /*
+     * A root is known to within about m * err / |p'(z)|; when that disc
+     * reaches the real axis the imaginary part is rounding noise.
+     */
+    for (int k = 0; k < m; k++)
+    {
+        double complex num, den;
+        double e;
+        newton_quotient(c, m, z[k], &num, &den, &e);
+        if (fabs(cimag(z[k])) * cabs(den) <= m * (e + cabs(num)))
+            z[k] = creal(z[k]);
+    }
+    return err;
+}
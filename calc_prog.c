@@ -0,0 +1,422 @@
+/*
+ * Calculator engine - compiled postfix programs and tiered formulas, see calc.h
+ */
+
+#include <math.h>
+#include <string.h>
+#include "calc.h"
+
+static int emit(const calc_node *n, calc_prog *prog, int depth)
+{
+    int err;
+
+    if (n->kind == CALC_NODE_OP)
+    {
+        /* Operands first; the deeper stack need of a and b decides depth */
+        if ((err = emit(n->a, prog, depth)) != 0)
+            return err;
+        if (n->b && (err = emit(n->b, prog, depth + 1)) != 0)
+            return err;
+    }
+    else if (depth + 1 > prog->depth)
+        prog->depth = depth + 1;
+
+    if (prog->len >= CALC_PROG_MAX)
+        return 4;
+    calc_ins *ins = &prog->code[prog->len++];
+    ins->kind = n->kind;
+    ins->op = n->op;
+    ins->var = n->var;
+    ins->num = n->num;
+    return 0;
+}
+
+int calc_compile(const calc_node *root, calc_prog *prog)
+{
+    prog->len = 0;
+    prog->depth = 0;
+    return emit(root, prog, 0);
+}
+
+int calc_prog_check(const calc_prog *prog, int var_count)
+{
+    int sp = 0, depth = 0;
+
+    if (prog->len < 1 || prog->len > CALC_PROG_MAX)
+        return 2;
+    for (int i = 0; i < prog->len; i++)
+    {
+        const calc_ins *ins = &prog->code[i];
+        switch (ins->kind)
+        {
+            case CALC_NODE_VAR:
+                if (ins->var < 0 || ins->var >= var_count)
+                    return 3;
+                break;
+            case CALC_NODE_RAND:
+                if (ins->op != CALC_RAND_UNIFORM && ins->op != CALC_RAND_NORMAL)
+                    return 2;
+                break;
+            case CALC_NODE_NUM:
+                break;
+            case CALC_NODE_OP:
+                if (ins->op < 0 || ins->op >= CALC_OP_COUNT)
+                    return 1;
+                if (sp < (calc_op_is_unary(ins->op) ? 1 : 2))
+                    return 2;
+                sp -= !calc_op_is_unary(ins->op);
+                continue;
+            default:
+                return 2;
+        }
+        if (++sp > depth)
+            depth = sp;
+    }
+    return (sp == 1 && prog->depth == depth) ? 0 : 2;
+}
+
+int calc_run(const calc_ctx *ctx, const calc_prog *prog, double *result)
+{
+    double st[CALC_PROG_MAX];
+    int sp = 0, err;
+
+    for (int i = 0; i < prog->len; i++)
+    {
+        const calc_ins *ins = &prog->code[i];
+        switch (ins->kind)
+        {
+            case CALC_NODE_NUM: st[sp++] = ins->num; continue;
+            case CALC_NODE_VAR: st[sp++] = ctx->var_values[ins->var]; continue;
+            case CALC_NODE_RAND: st[sp++] = calc_rand_node(ctx, ins->op, ins->var, ctx->rng_counter); continue;
+            default: break;
+        }
+        switch (ins->op)
+        {
+            case CALC_OP_ADD: sp--; st[sp - 1] += st[sp]; continue;
+            case CALC_OP_SUB: sp--; st[sp - 1] -= st[sp]; continue;
+            case CALC_OP_MUL: sp--; st[sp - 1] *= st[sp]; continue;
+            case CALC_OP_NEG: st[sp - 1] = -st[sp - 1]; continue;
+            default: break;
+        }
+        if (calc_op_is_unary(ins->op))
+            err = calc_compute_op(ctx, st[sp - 1], 0, ins->op, &st[sp - 1]);
+        else
+        {
+            sp--;
+            err = calc_compute_op(ctx, st[sp - 1], st[sp], ins->op, &st[sp - 1]);
+        }
+        if (err != 0)
+            return err;
+    }
+    *result = st[0];
+    return 0;
+}
+
+/*
+ * Evaluates one block of up to CALC_LANES inputs; bad[] marks lanes that hit an
+ * error. sample is the random-number sample of lane 0.
+ */
+static void run_block(const calc_ctx *ctx, const calc_prog *prog, int var, unsigned long long sample,
+                      const double *x, double *out, int lanes, int bad[CALC_LANES])
+{
+    double st[CALC_PROG_MAX][CALC_LANES];
+    int sp = 0;
+
+    for (int i = 0; i < prog->len; i++)
+    {
+        const calc_ins *ins = &prog->code[i];
+        double *t;
+
+        if (ins->kind != CALC_NODE_OP)
+        {
+            t = st[sp++];
+            if (ins->kind == CALC_NODE_VAR && ins->var == var)
+            {
+                memcpy(t, x, lanes * sizeof(double));
+                for (int l = lanes; l < CALC_LANES; l++)
+                    t[l] = 0;
+            }
+            else if (ins->kind == CALC_NODE_RAND)
+            {
+                for (int l = 0; l < CALC_LANES; l++)
+                    t[l] = calc_rand_node(ctx, ins->op, ins->var, sample + l);
+            }
+            else
+            {
+                double v = (ins->kind == CALC_NODE_NUM) ? ins->num : ctx->var_values[ins->var];
+                for (int l = 0; l < CALC_LANES; l++)
+                    t[l] = v;
+            }
+            continue;
+        }
+
+        int unary = calc_op_is_unary(ins->op);
+        if (!unary)
+            sp--;
+        t = st[sp - 1];
+        const double *u = st[sp];  /* right operand, unused for unary ops */
+
+        switch (ins->op)
+        {
+            case CALC_OP_ADD: for (int l = 0; l < CALC_LANES; l++) t[l] += u[l]; continue;
+            case CALC_OP_SUB: for (int l = 0; l < CALC_LANES; l++) t[l] -= u[l]; continue;
+            case CALC_OP_MUL: for (int l = 0; l < CALC_LANES; l++) t[l] *= u[l]; continue;
+            case CALC_OP_NEG: for (int l = 0; l < CALC_LANES; l++) t[l] = -t[l]; continue;
+            case CALC_OP_LT:  for (int l = 0; l < CALC_LANES; l++) t[l] = t[l] < u[l]; continue;
+            case CALC_OP_LE:  for (int l = 0; l < CALC_LANES; l++) t[l] = t[l] <= u[l]; continue;
+            case CALC_OP_GT:  for (int l = 0; l < CALC_LANES; l++) t[l] = t[l] > u[l]; continue;
+            case CALC_OP_GE:  for (int l = 0; l < CALC_LANES; l++) t[l] = t[l] >= u[l]; continue;
+            case CALC_OP_EQ:  for (int l = 0; l < CALC_LANES; l++) t[l] = t[l] == u[l]; continue;
+            case CALC_OP_NE:  for (int l = 0; l < CALC_LANES; l++) t[l] = t[l] != u[l]; continue;
+            default: break;
+        }
+        for (int l = 0; l < lanes; l++)
+            if (calc_compute_op(ctx, t[l], unary ? 0 : u[l], ins->op, &t[l]) != 0)
+            {
+                bad[l] = 1;
+                t[l] = NAN;
+            }
+    }
+    memcpy(out, st[0], lanes * sizeof(double));
+}
+
+size_t calc_run_batch(const calc_ctx *ctx, const calc_prog *prog, int var,
+                      const double *x, double *out, size_t n)
+{
+    size_t errors = 0;
+
+    for (size_t i = 0; i < n; i += CALC_LANES)
+    {
+        int lanes = (n - i < CALC_LANES) ? (int)(n - i) : CALC_LANES;
+        int bad[CALC_LANES] = { 0 };
+        run_block(ctx, prog, var, ctx->rng_counter + i, x ? x + i : NULL, out + i, lanes, bad);
+        for (int l = 0; l < lanes; l++)
+            if (bad[l])
+            {
+                out[i + l] = NAN;
+                errors++;
+            }
+    }
+    return errors;
+}
+
+/*
+ * Complex counterpart of run_block(): the stack holds the real and imaginary
+ * parts of each lane in separate arrays, so the operators handled inline are
+ * the same loops over lanes as in run_block().
+ */
+static void run_block_complex(const calc_ctx *ctx, const calc_prog *prog, int var, unsigned long long sample,
+                              const double *xr, const double *xi, double *out_re, double *out_im,
+                              int lanes, int bad[CALC_LANES])
+{
+    double re[CALC_PROG_MAX][CALC_LANES], im[CALC_PROG_MAX][CALC_LANES];
+    int sp = 0;
+
+    for (int i = 0; i < prog->len; i++)
+    {
+        const calc_ins *ins = &prog->code[i];
+        double *tr, *ti;
+
+        if (ins->kind != CALC_NODE_OP)
+        {
+            tr = re[sp];
+            ti = im[sp++];
+            for (int l = 0; l < CALC_LANES; l++)
+                ti[l] = 0;
+            if (ins->kind == CALC_NODE_VAR && ins->var == var)
+            {
+                memcpy(tr, xr, lanes * sizeof(double));
+                if (xi)
+                    memcpy(ti, xi, lanes * sizeof(double));
+                for (int l = lanes; l < CALC_LANES; l++)
+                    tr[l] = 0;
+            }
+            else if (ins->kind == CALC_NODE_RAND)
+            {
+                for (int l = 0; l < CALC_LANES; l++)
+                    tr[l] = calc_rand_node(ctx, ins->op, ins->var, sample + l);
+            }
+            else
+            {
+                double v = (ins->kind == CALC_NODE_NUM) ? ins->num : ctx->var_values[ins->var];
+                for (int l = 0; l < CALC_LANES; l++)
+                    tr[l] = v;
+            }
+            continue;
+        }
+
+        int unary = calc_op_is_unary(ins->op);
+        if (!unary)
+            sp--;
+        tr = re[sp - 1];
+        ti = im[sp - 1];
+        const double *ur = re[sp], *ui = im[sp];  /* right operand, unused for unary ops */
+
+        switch (ins->op)
+        {
+            case CALC_OP_ADD:
+                for (int l = 0; l < CALC_LANES; l++) { tr[l] += ur[l]; ti[l] += ui[l]; }
+                continue;
+            case CALC_OP_SUB:
+                for (int l = 0; l < CALC_LANES; l++) { tr[l] -= ur[l]; ti[l] -= ui[l]; }
+                continue;
+            case CALC_OP_MUL:
+                for (int l = 0; l < CALC_LANES; l++)
+                {
+                    double r = tr[l] * ur[l] - ti[l] * ui[l];
+                    ti[l] = tr[l] * ui[l] + ti[l] * ur[l];
+                    tr[l] = r;
+                }
+                continue;
+            case CALC_OP_NEG:
+                for (int l = 0; l < CALC_LANES; l++) { tr[l] = -tr[l]; ti[l] = 0 - ti[l]; }
+                continue;
+            case CALC_OP_CONJ: for (int l = 0; l < CALC_LANES; l++) ti[l] = -ti[l]; continue;
+            case CALC_OP_RE:   for (int l = 0; l < CALC_LANES; l++) ti[l] = 0; continue;
+            case CALC_OP_IM:   for (int l = 0; l < CALC_LANES; l++) { tr[l] = ti[l]; ti[l] = 0; } continue;
+            case CALC_OP_MUL_I:
+                for (int l = 0; l < CALC_LANES; l++)
+                {
+                    double r = -ti[l];
+                    ti[l] = tr[l];
+                    tr[l] = r;
+                }
+                continue;
+            default: break;
+        }
+        for (int l = 0; l < lanes; l++)
+        {
+            double complex z;
+            if (calc_compute_complex_op(ctx, tr[l] + ti[l] * I, unary ? 0 : ur[l] + ui[l] * I, ins->op, &z) != 0)
+            {
+                bad[l] = 1;
+                z = NAN;
+            }
+            tr[l] = creal(z);
+            ti[l] = cimag(z);
+        }
+    }
+    memcpy(out_re, re[0], lanes * sizeof(double));
+    memcpy(out_im, im[0], lanes * sizeof(double));
+}
+
+size_t calc_run_batch_complex(const calc_ctx *ctx, const calc_prog *prog, int var,
+                              const double *re, const double *im, double *out_re, double *out_im, size_t n)
+{
+    size_t errors = 0;
+
+    for (size_t i = 0; i < n; i += CALC_LANES)
+    {
+        int lanes = (n - i < CALC_LANES) ? (int)(n - i) : CALC_LANES;
+        int bad[CALC_LANES] = { 0 };
+        run_block_complex(ctx, prog, var, ctx->rng_counter + i, re ? re + i : NULL, im ? im + i : NULL,
+                          out_re + i, out_im + i, lanes, bad);
+        for (int l = 0; l < lanes; l++)
+            if (bad[l])
+            {
+                out_re[i + l] = out_im[i + l] = NAN;
+                errors++;
+            }
+    }
+    return errors;
+}
+
+/*
+ * Dual-number run: direction k of the result is the derivative with respect to
+ * variable slot seed[k]. Slot var, if not -1, reads x instead of its context value.
+ */
+static int run_dual(const calc_ctx *ctx, const calc_prog *prog, const int *seed, int n,
+                    int var, double x, calc_dual *result)
+{
+    calc_dual st[CALC_PROG_MAX];
+    int sp = 0, err;
+
+    for (int i = 0; i < prog->len; i++)
+    {
+        const calc_ins *ins = &prog->code[i];
+        if (ins->kind != CALC_NODE_OP)
+        {
+            calc_dual *t = &st[sp++];
+            memset(t, 0, sizeof(*t));
+            if (ins->kind == CALC_NODE_NUM)
+                t->v = ins->num;
+            else if (ins->kind == CALC_NODE_RAND)
+                t->v = calc_rand_node(ctx, ins->op, ins->var, ctx->rng_counter);
+            else
+            {
+                t->v = (ins->var == var) ? x : ctx->var_values[ins->var];
+                for (int k = 0; k < n; k++)
+                    t->d[k] = (ins->var == seed[k]);
+            }
+            continue;
+        }
+        if (calc_op_is_unary(ins->op))
+            err = calc_compute_dual_op(ctx, &st[sp - 1], &st[sp - 1], ins->op, &st[sp - 1]);
+        else
+        {
+            sp--;
+            err = calc_compute_dual_op(ctx, &st[sp - 1], &st[sp], ins->op, &st[sp - 1]);
+        }
+        if (err != 0)
+            return err;
+    }
+    *result = st[0];
+    return 0;
+}
+
+int calc_run_dual(const calc_ctx *ctx, const calc_prog *prog, int var, double x,
+                  double *fx, double *dfx)
+{
+    calc_dual r;
+    int err = run_dual(ctx, prog, &var, 1, var, x, &r);
+    if (err != 0)
+        return err;
+    *fx = r.v;
+    *dfx = r.d[0];
+    return 0;
+}
+
+int calc_run_grad(const calc_ctx *ctx, const calc_prog *prog, const int *vars, int n, calc_dual *result)
+{
+    if (n < 0 || n > CALC_DUAL_N)
+        return 4;
+    return run_dual(ctx, prog, vars, n, -1, 0, result);
+}
+
+int calc_prog_vars(const calc_prog *prog, int *vars, int max)
+{
+    char seen[CALC_MAX_VARS] = { 0 };
+    int n = 0;
+
+    for (int i = 0; i < prog->len; i++)
+    {
+        const calc_ins *ins = &prog->code[i];
+        if (ins->kind != CALC_NODE_VAR || seen[ins->var])
+            continue;
+        seen[ins->var] = 1;
+        if (n < max)
+            vars[n] = ins->var;
+        n++;
+    }
+    return n;
+}
+
+void calc_formula_init(calc_formula *f, const calc_node *root)
+{
+    f->root = root;
+    f->calls = 0;
+    f->compiled = 0;
+    f->prog.len = 0;
+}
+
+int calc_formula_eval(const calc_ctx *ctx, calc_formula *f, double *result)
+{
+    if (f->compiled)
+        return calc_run(ctx, &f->prog, result);
+    if (++f->calls >= CALC_HOT_CALLS && calc_compile(f->root, &f->prog) == 0)
+    {
+        f->compiled = 1;
+        return calc_run(ctx, &f->prog, result);
+    }
+    return calc_eval(ctx, f->root, result);
+}
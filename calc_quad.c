@@ -0,0 +1,300 @@
+/*
+ * Calculator engine - adaptive integration and series summation, see calc.h
+ */
+
+#include <math.h>
+#include <float.h>
+#include "calc.h"
+
+#define QUAD_PIECES     16    /* independent pieces of [a, b], one task each */
+#define QUAD_INTERVALS  128   /* subintervals per piece before giving up */
+#define SUM_BLOCKS      64    /* independent blocks of the summation range */
+#define SUM_CHUNK       256   /* terms evaluated per calc_run_batch() call */
+
+/* Gauss-Kronrod 7-15 abscissae and weights (QUADPACK qk15), index 7 is the centre */
+static const double xgk[8] =
+{
+    0.991455371120812639206854697526329, 0.949107912342758524526189684047851,
+    0.864864423359769072789712788640926, 0.741531185599394439863864773280788,
+    0.586087235467691130294144845693013, 0.405845151377397166906606412076961,
+    0.207784955007898467600689403773245, 0.000000000000000000000000000000000
+};
+static const double wgk[8] =
+{
+    0.022935322010529224963732008058970, 0.063092092629978553290700663189204,
+    0.104790010322250183839876322541518, 0.140653259715525918745189590510238,
+    0.169004726639267902826583426598550, 0.190350578064785409913256402421014,
+    0.204432940075298892414161999234649, 0.209482141084727828012999174891714
+};
+static const double wg[4] =  /* 7-point Gauss weights for xgk[1], xgk[3], xgk[5], xgk[7] */
+{
+    0.129484966168869693270611432679082, 0.279705391489276667901467771423780,
+    0.381830050505118944950369775488975, 0.417959183673469387755102040816327
+};
+
+typedef struct interval
+{
+    double a, b;
+    double result;  /* Kronrod estimate */
+    double err;     /* |Kronrod - Gauss| */
+    double resabs;  /* integral of |f|, scales the round-off floor */
+} interval;
+
+/* Neumaier's improved Kahan summation: *sum + *comp carries the running total */
+static void neumaier_add(double *sum, double *comp, double x)
+{
+    double t = *sum + x;
+    if (fabs(*sum) >= fabs(x))
+        *comp += (*sum - t) + x;
+    else
+        *comp += (x - t) + *sum;
+    *sum = t;
+}
+
+/*
+ * Applies the 15-point rule to iv; all nodes go through one batch evaluation.
+ * rand() in the formula draws samples ctx->rng_counter + sample onwards.
+ */
+static int gk15(const calc_ctx *ctx, const calc_prog *prog, int var, interval *iv,
+                unsigned long long sample)
+{
+    double c = 0.5 * (iv->a + iv->b), h = 0.5 * (iv->b - iv->a);
+    double x[15], f[15];
+    calc_ctx cc = *ctx;
+
+    for (int j = 0; j < 7; j++)
+    {
+        x[2 * j] = c - h * xgk[j];
+        x[2 * j + 1] = c + h * xgk[j];
+    }
+    x[14] = c;
+    cc.rng_counter = ctx->rng_counter + sample;
+    if (calc_run_batch(&cc, prog, var, x, f, 15) != 0)
+        return -2;
+
+    double k = wgk[7] * f[14], g = wg[3] * f[14], kabs = wgk[7] * fabs(f[14]);
+    for (int j = 0; j < 7; j++)
+    {
+        double pair = f[2 * j] + f[2 * j + 1];
+        k += wgk[j] * pair;
+        kabs += wgk[j] * (fabs(f[2 * j]) + fabs(f[2 * j + 1]));
+        if (j & 1)
+            g += wg[j / 2] * pair;
+    }
+    iv->result = k * h;
+    iv->resabs = kabs * fabs(h);
+    iv->err = fabs((k - g) * h);
+    return 0;
+}
+
+/* One of the QUAD_PIECES fixed parts of [a, b] with its subintervals so far */
+typedef struct piece
+{
+    interval iv[QUAD_INTERVALS];
+    int n;
+    int status;
+    unsigned long long sample;  /* next rand() sample, so no two rule applications share draws */
+    double result, abserr, resabs;
+} piece;
+
+/* Sums the subintervals of pc and returns the one with the largest error */
+static int piece_total(piece *pc)
+{
+    double total = 0, comp = 0;
+    int worst = 0;
+
+    pc->abserr = 0;
+    pc->resabs = 0;
+    for (int i = 0; i < pc->n; i++)
+    {
+        neumaier_add(&total, &comp, pc->iv[i].result);
+        pc->abserr += pc->iv[i].err;
+        pc->resabs += pc->iv[i].resabs;
+        if (pc->iv[i].err > pc->iv[worst].err)
+            worst = i;
+    }
+    pc->result = total + comp;
+    return worst;
+}
+
+/*
+ * Globally adaptive integration of one piece: always bisects the subinterval
+ * with the largest error until the piece's summed error is within target
+ * (tol relative to the piece's own result when target is negative) or its
+ * round-off floor. Returns how many subintervals it added.
+ */
+static int refine_piece(const calc_ctx *ctx, const calc_prog *prog, int var, piece *pc,
+                        double tol, double target)
+{
+    int added = 0;
+
+    for (;;)
+    {
+        int worst = piece_total(pc);
+        double goal = (target < 0) ? tol * fabs(pc->result) : target;
+        if (pc->abserr <= fmax(goal, 50 * DBL_EPSILON * pc->resabs))
+        {
+            pc->status = 0;
+            return added;
+        }
+        if (pc->n == QUAD_INTERVALS)
+        {
+            pc->status = 5;
+            return added;
+        }
+
+        interval *w = &pc->iv[worst], *v = &pc->iv[pc->n];
+        double mid = 0.5 * (w->a + w->b);
+        v->a = mid;
+        v->b = w->b;
+        w->b = mid;
+        if ((pc->status = gk15(ctx, prog, var, w, pc->sample)) != 0 ||
+            (pc->status = gk15(ctx, prog, var, v, pc->sample + 15)) != 0)
+            return added;
+        pc->sample += 30;
+        pc->n++;
+        added++;
+    }
+}
+
+/*
+ * Pieces first refine to tol relative to their own results, in parallel. If
+ * their summed error is still over tol relative to the total, as happens when
+ * pieces cancel, every piece refines again toward an equal share of that
+ * global budget, until it is met or no piece can bisect any further.
+ */
+int calc_integrate(const calc_ctx *ctx, const calc_prog *prog, int var, double a, double b,
+                   double tol, double *result, double *abserr)
+{
+    piece pc[QUAD_PIECES];
+    double target = -1;
+
+    if (!isfinite(a) || !isfinite(b))
+        return -2;
+
+    for (int p = 0; p < QUAD_PIECES; p++)
+    {
+        pc[p].iv[0].a = a + (b - a) * p / QUAD_PIECES;
+        pc[p].iv[0].b = (p == QUAD_PIECES - 1) ? b : a + (b - a) * (p + 1) / QUAD_PIECES;
+        pc[p].n = 0;
+        pc[p].sample = (unsigned long long)p * (2 * QUAD_INTERVALS) * 15;
+    }
+
+    for (;;)
+    {
+        int added = 0;
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(dynamic, 1) reduction(+:added)
+#endif
+        for (int p = 0; p < QUAD_PIECES; p++)
+        {
+            if (pc[p].n == 0)
+            {
+                pc[p].n = 1;
+                pc[p].status = gk15(ctx, prog, var, &pc[p].iv[0], pc[p].sample);
+                pc[p].sample += 15;
+                if (pc[p].status != 0)
+                    continue;
+            }
+            else if (pc[p].status < 0)
+                continue;
+            added += refine_piece(ctx, prog, var, &pc[p], tol, target);
+        }
+
+        /* Combine in piece order so the result does not depend on the thread count */
+        double sum = 0, comp = 0, errsum = 0, resabs = 0;
+        for (int p = 0; p < QUAD_PIECES; p++)
+        {
+            if (pc[p].status < 0)
+                return pc[p].status;
+            neumaier_add(&sum, &comp, pc[p].result);
+            errsum += pc[p].abserr;
+            resabs += pc[p].resabs;
+        }
+        *result = sum + comp;
+        *abserr = errsum;
+        if (errsum <= fmax(tol * fabs(*result), 50 * DBL_EPSILON * resabs))
+            return 0;
+        if (target >= 0 && added == 0)
+            return 5;
+        target = tol * fabs(*result) / (2 * QUAD_PIECES);
+    }
+}
+
+int calc_sum(const calc_ctx *ctx, const calc_prog *prog, int var, long long lo, long long hi,
+             double *result, long long *bad_term)
+{
+    double part[SUM_BLOCKS], pcomp[SUM_BLOCKS];
+    long long bad[SUM_BLOCKS];
+    int status[SUM_BLOCKS];
+
+    if (hi < lo)
+    {
+        *result = 0;
+        return 0;
+    }
+    /* hi - lo overflows for ranges wider than LLONG_MAX, but not in unsigned */
+    unsigned long long span = (unsigned long long)hi - (unsigned long long)lo;
+    if (span >= CALC_SUM_MAX)
+        return 4;
+    long long count = (long long)span + 1;
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic, 1)
+#endif
+    for (int blk = 0; blk < SUM_BLOCKS; blk++)
+    {
+        long long first = lo + count / SUM_BLOCKS * blk + (blk < count % SUM_BLOCKS ? blk : count % SUM_BLOCKS);
+        long long len = count / SUM_BLOCKS + (blk < count % SUM_BLOCKS);
+        double k[SUM_CHUNK], f[SUM_CHUNK], sum = 0, comp = 0;
+        calc_ctx c = *ctx;
+
+        status[blk] = 0;
+        for (long long i = 0; i < len; i += SUM_CHUNK)
+        {
+            int m = (len - i < SUM_CHUNK) ? (int)(len - i) : SUM_CHUNK;
+            for (int j = 0; j < m; j++)
+                k[j] = (double)(first + i + j);
+            /* Term k draws sample rng_counter + k, whatever range it is summed in */
+            c.rng_counter = ctx->rng_counter + (unsigned long long)(first + i);
+            if (calc_run_batch(&c, prog, var, k, f, m) != 0)
+            {
+                /* Rerun the failed lanes one at a time for the first error code */
+                for (int j = 0; j < m && status[blk] == 0; j++)
+                {
+                    if (!isnan(f[j]))
+                        continue;
+                    c.var_values[var] = k[j];
+                    c.rng_counter = ctx->rng_counter + (unsigned long long)(first + i + j);
+                    status[blk] = calc_run(&c, prog, &f[j]);
+                    bad[blk] = first + i + j;
+                }
+                if (status[blk] == 0)
+                {
+                    status[blk] = -2;
+                    bad[blk] = first + i;
+                }
+                break;
+            }
+            for (int j = 0; j < m; j++)
+                neumaier_add(&sum, &comp, f[j]);
+        }
+        part[blk] = sum;
+        pcomp[blk] = comp;
+    }
+
+    double sum = 0, comp = 0;
+    for (int blk = 0; blk < SUM_BLOCKS; blk++)
+    {
+        if (status[blk] != 0)
+        {
+            if (bad_term)
+                *bad_term = bad[blk];
+            return status[blk];
+        }
+        neumaier_add(&sum, &comp, part[blk]);
+        neumaier_add(&sum, &comp, pcomp[blk]);
+    }
+    *result = sum + comp;
+    return 0;
+}
@@ -0,0 +1,132 @@
+/*
+ * Calculator engine - counter-based random numbers and Monte Carlo, see calc.h
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include "calc.h"
+
+#define MC_BLOCKS  256   /* independent sample blocks, merged in order */
+#define MC_CHUNK   256   /* samples per calc_run_batch() call */
+
+/* Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3") */
+static void philox4x32(uint32_t ctr[4], uint32_t k0, uint32_t k1)
+{
+    for (int round = 0; round < 10; round++)
+    {
+        uint64_t p0 = (uint64_t)0xD2511F53u * ctr[0];
+        uint64_t p1 = (uint64_t)0xCD9E8D57u * ctr[2];
+        uint32_t c0 = (uint32_t)(p1 >> 32) ^ ctr[1] ^ k0;
+        uint32_t c2 = (uint32_t)(p0 >> 32) ^ ctr[3] ^ k1;
+        ctr[1] = (uint32_t)p1;
+        ctr[3] = (uint32_t)p0;
+        ctr[0] = c0;
+        ctr[2] = c2;
+        k0 += 0x9E3779B9u;
+        k1 += 0xBB67AE85u;
+    }
+}
+
+static void block(unsigned long long seed, unsigned long long sample, unsigned stream, uint32_t out[4])
+{
+    out[0] = (uint32_t)sample;
+    out[1] = (uint32_t)(sample >> 32);
+    out[2] = stream;
+    out[3] = 0;
+    philox4x32(out, (uint32_t)seed, (uint32_t)(seed >> 32));
+}
+
+/* 53 random bits mapped into the open interval (0, 1) */
+static double to_unit(uint32_t hi, uint32_t lo)
+{
+    uint64_t bits = ((uint64_t)hi << 21) ^ (lo >> 11);
+    return ((double)bits + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+double calc_rand_uniform(unsigned long long seed, unsigned long long sample, unsigned stream)
+{
+    uint32_t r[4];
+    block(seed, sample, stream, r);
+    return to_unit(r[0], r[1]);
+}
+
+double calc_rand_normal(unsigned long long seed, unsigned long long sample, unsigned stream)
+{
+    /* Box-Muller on the two halves of one Philox block */
+    uint32_t r[4];
+    block(seed, sample, stream, r);
+    double u1 = to_unit(r[0], r[1]), u2 = to_unit(r[2], r[3]);
+    return sqrt(-2.0 * log(u1)) * cos(2.0 * CALC_PI * u2);
+}
+
+double calc_rand_node(const calc_ctx *ctx, int kind, int stream, unsigned long long sample)
+{
+    if (kind == CALC_RAND_NORMAL)
+        return calc_rand_normal(ctx->rng_seed, sample, (unsigned)stream);
+    return calc_rand_uniform(ctx->rng_seed, sample, (unsigned)stream);
+}
+
+int calc_montecarlo(const calc_ctx *ctx, const calc_prog *prog, long long n,
+                    double *mean, double *variance)
+{
+    double bmean[MC_BLOCKS], bm2[MC_BLOCKS];
+    long long bcount[MC_BLOCKS];
+    int status[MC_BLOCKS];
+
+    if (n <= 0)
+        return -2;
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic, 1)
+#endif
+    for (int blk = 0; blk < MC_BLOCKS; blk++)
+    {
+        long long first = n / MC_BLOCKS * blk + (blk < n % MC_BLOCKS ? blk : n % MC_BLOCKS);
+        long long len = n / MC_BLOCKS + (blk < n % MC_BLOCKS);
+        double f[MC_CHUNK], m = 0, m2 = 0;
+        long long count = 0;
+        calc_ctx c = *ctx;
+
+        status[blk] = 0;
+        for (long long i = 0; i < len; i += MC_CHUNK)
+        {
+            int k = (len - i < MC_CHUNK) ? (int)(len - i) : MC_CHUNK;
+            c.rng_counter = ctx->rng_counter + (unsigned long long)(first + i);
+            if (calc_run_batch(&c, prog, -1, NULL, f, k) != 0)
+            {
+                status[blk] = -2;
+                break;
+            }
+            /* Welford's update keeps the variance accurate over long runs */
+            for (int j = 0; j < k; j++)
+            {
+                double d = f[j] - m;
+                count++;
+                m += d / count;
+                m2 += d * (f[j] - m);
+            }
+        }
+        bmean[blk] = m;
+        bm2[blk] = m2;
+        bcount[blk] = count;
+    }
+
+    /* Chan et al. pairwise merge of the block statistics, in block order */
+    double m = 0, m2 = 0;
+    long long count = 0;
+    for (int blk = 0; blk < MC_BLOCKS; blk++)
+    {
+        if (status[blk] != 0)
+            return status[blk];
+        if (bcount[blk] == 0)
+            continue;
+        long long total = count + bcount[blk];
+        double d = bmean[blk] - m;
+        m += d * bcount[blk] / total;
+        m2 += bm2[blk] + d * d * ((double)count * bcount[blk] / total);
+        count = total;
+    }
+    *mean = m;
+    *variance = (count > 1) ? m2 / (count - 1) : 0;
+    return 0;
+}
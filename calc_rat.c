@@ -0,0 +1,468 @@
+/*
+ * Calculator engine - exact rational arithmetic, see calc.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "calc.h"
+
+__extension__ typedef unsigned __int128 u128;
+
+#define I64_FITS(x) ((x) >= -(calc_i128)0x7fffffffffffffffLL && (x) <= (calc_i128)0x7fffffffffffffffLL)
+
+static void exact_or_inexact(const calc_rat *a, const calc_rat *b, int kind, calc_rat *r);
+
+static int ctz128(u128 x)
+{
+    unsigned long long lo = (unsigned long long)x;
+    return lo ? __builtin_ctzll(lo) : 64 + __builtin_ctzll((unsigned long long)(x >> 64));
+}
+
+/* Stein's binary GCD: shifts and subtractions only, 64-bit when both operands fit */
+static u128 gcd(u128 a, u128 b)
+{
+    if (a == 0) return b;
+    if (b == 0) return a;
+
+    int shift = ctz128(a | b);
+    if ((a >> 64) == 0 && (b >> 64) == 0)
+    {
+        unsigned long long x = (unsigned long long)a, y = (unsigned long long)b;
+        x >>= __builtin_ctzll(x);
+        do
+        {
+            y >>= __builtin_ctzll(y);
+            if (x > y) { unsigned long long t = x; x = y; y = t; }
+            y -= x;
+        } while (y);
+        return (u128)x << shift;
+    }
+
+    a >>= ctz128(a);
+    do
+    {
+        b >>= ctz128(b);
+        if (a > b) { u128 t = a; a = b; b = t; }
+        b -= a;
+    } while (b);
+    return a << shift;
+}
+
+static u128 mag(calc_i128 x)
+{
+    return x < 0 ? (u128)0 - (u128)x : (u128)x;
+}
+
+static void set_inexact(calc_rat *r, double v)
+{
+    r->num = 0;
+    r->den = 1;
+    r->inexact = 1;
+    r->approx = v;
+}
+
+/* Stores num/den, keeping the denominator positive; den must be non-zero */
+static void set_frac(calc_rat *r, calc_i128 num, calc_i128 den)
+{
+    if (den < 0)
+    {
+        num = -num;
+        den = -den;
+    }
+    r->num = num;
+    r->den = den;
+    r->inexact = 0;
+    r->approx = 0;
+}
+
+void calc_rat_from_int(calc_rat *r, long long n)
+{
+    set_frac(r, n, 1);
+}
+
+double calc_rat_value(const calc_rat *r)
+{
+    if (r->inexact)
+        return r->approx;
+    return (double)((long double)r->num / (long double)r->den);
+}
+
+void calc_rat_normalize(calc_rat *r)
+{
+    if (r->inexact)
+        return;
+    u128 g = gcd(mag(r->num), (u128)r->den);
+    if (g > 1)
+    {
+        r->num /= (calc_i128)g;
+        r->den /= (calc_i128)g;
+    }
+}
+
+/* Exact value of a binary double; decimals like 0.1 are recovered by calc_rat_from_double() */
+static void from_binary(calc_rat *r, double v)
+{
+    int e;
+    double f = frexp(v, &e);
+    long long m = (long long)ldexp(f, 53);
+    e -= 53;
+    if (e >= 0 && e < 126 - 53)
+    {
+        /* Shift the magnitude: left-shifting a negative value is undefined */
+        calc_i128 big = (calc_i128)(m < 0 ? -m : m) << e;
+        set_frac(r, (m < 0) ? -big : big, 1);
+    }
+    else if (e < 0 && -e < 126)
+        set_frac(r, m, (calc_i128)1 << -e);
+    else
+    {
+        set_inexact(r, v);
+        return;
+    }
+    calc_rat_normalize(r);
+}
+
+void calc_rat_from_double(calc_rat *r, double v)
+{
+    char buf[32];
+
+    if (!isfinite(v))
+    {
+        set_inexact(r, v);
+        return;
+    }
+    /* A double typed as a short decimal prints back as that decimal at 15 digits */
+    snprintf(buf, sizeof(buf), "%.15g", v);
+    if (strtod(buf, NULL) == v && calc_rat_parse(buf, r) == 0 && !r->inexact)
+        return;
+    from_binary(r, v);
+}
+
+/* Parses an unsigned decimal "ddd.ddd[e[+-]dd]" into num/den; returns chars used or 0 */
+/* *m = *m * 10 + digit unless that exceeds the calc_i128 range; returns 1 if it would */
+static int mul10_add(u128 *m, unsigned digit)
+{
+    if (*m > ((~(u128)0 >> 1) - digit) / 10)
+        return 1;
+    *m = *m * 10 + digit;
+    return 0;
+}
+
+static int parse_decimal(const char *s, calc_rat *r)
+{
+    const char *p = s;
+    u128 m = 0;
+    int frac = 0, digits = 0, overflow = 0;
+
+    for (; *p >= '0' && *p <= '9'; p++, digits++)
+        overflow = overflow || mul10_add(&m, (unsigned)(*p - '0'));
+    if (*p == '.')
+        for (p++; *p >= '0' && *p <= '9'; p++, digits++, frac++)
+            overflow = overflow || mul10_add(&m, (unsigned)(*p - '0'));
+    if (digits == 0)
+        return 0;
+
+    int exp10 = -frac;
+    if ((*p == 'e' || *p == 'E') && (p[1] == '-' || p[1] == '+' || (p[1] >= '0' && p[1] <= '9')))
+    {
+        char *end;
+        exp10 += (int)strtol(p + 1, &end, 10);
+        p = end;
+    }
+
+    u128 num = m, den = 1;
+    for (; exp10 > 0 && !overflow; exp10--)
+        overflow = mul10_add(&num, 0);
+    for (; exp10 < 0 && !overflow; exp10++)
+        overflow = mul10_add(&den, 0);
+    if (overflow)
+        set_inexact(r, strtod(s, NULL));
+    else
+        set_frac(r, (calc_i128)num, (calc_i128)den);
+    return (int)(p - s);
+}
+
+int calc_rat_parse(const char *s, calc_rat *r)
+{
+    int neg = 0, n;
+    calc_rat den;
+
+    if (*s == '-' || *s == '+')
+        neg = (*s++ == '-');
+    if ((n = parse_decimal(s, r)) == 0)
+        return -1;
+    s += n;
+    if (*s == '/')
+    {
+        if ((n = parse_decimal(s + 1, &den)) == 0 || s[1 + n] != '\0' || calc_rat_value(&den) == 0)
+            return -1;
+        if (r->inexact || den.inexact)
+            set_inexact(r, calc_rat_value(r) / calc_rat_value(&den));
+        else
+        {
+            set_frac(&den, den.den, den.num);
+            exact_or_inexact(r, &den, CALC_OP_MUL, r);
+        }
+    }
+    else if (*s != '\0')
+        return -1;
+    if (neg)
+    {
+        r->num = -r->num;
+        r->approx = -r->approx;
+    }
+    return 0;
+}
+
+/* a*b and c*d products with overflow detection; returns 0 on success */
+static int mul_ok(calc_i128 a, calc_i128 b, calc_i128 *out)
+{
+    if (I64_FITS(a) && I64_FITS(b))
+    {
+        *out = a * b;  /* two 64-bit factors cannot overflow 128 bits */
+        return 0;
+    }
+    return __builtin_mul_overflow(a, b, out);
+}
+
+static int try_add(const calc_rat *a, const calc_rat *b, int sign, calc_rat *r)
+{
+    calc_i128 x, y, den;
+    if (a->den == b->den)
+    {
+        /* Common denominators, e.g. chains of same-sized fractions, skip the cross products */
+        if (__builtin_add_overflow(a->num, sign * b->num, &x))
+            return -1;
+        set_frac(r, x, a->den);
+        return 0;
+    }
+    calc_i128 g = (calc_i128)gcd((u128)a->den, (u128)b->den);
+    if (mul_ok(a->num, b->den / g, &x) || mul_ok(b->num, a->den / g, &y) ||
+        mul_ok(a->den / g, b->den, &den) || __builtin_add_overflow(x, sign * y, &x))
+        return -1;
+    set_frac(r, x, den);
+    return 0;
+}
+
+static int try_mul(const calc_rat *a, const calc_rat *b, calc_rat *r)
+{
+    calc_i128 num, den;
+    if (mul_ok(a->num, b->num, &num) || mul_ok(a->den, b->den, &den))
+        return -1;
+    set_frac(r, num, den);
+    return 0;
+}
+
+/* Runs op lazily on the operands as given; on overflow reduces them and tries once more */
+static void exact_or_inexact(const calc_rat *a, const calc_rat *b, int kind, calc_rat *r)
+{
+    calc_rat x = *a, y = *b;
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        int err = (kind == CALC_OP_MUL) ? try_mul(&x, &y, r)
+                                        : try_add(&x, &y, kind == CALC_OP_SUB ? -1 : 1, r);
+        if (err == 0)
+            return;
+        calc_rat_normalize(&x);
+        calc_rat_normalize(&y);
+        if (kind == CALC_OP_MUL)
+        {
+            /* Cross-cancel so a/b * c/d only multiplies what cannot cancel */
+            calc_i128 g1 = (calc_i128)gcd(mag(x.num), (u128)y.den);
+            calc_i128 g2 = (calc_i128)gcd(mag(y.num), (u128)x.den);
+            if (g1 > 1) { x.num /= g1; y.den /= g1; }
+            if (g2 > 1) { y.num /= g2; x.den /= g2; }
+        }
+    }
+    double va = calc_rat_value(a), vb = calc_rat_value(b);
+    set_inexact(r, kind == CALC_OP_MUL ? va * vb : kind == CALC_OP_SUB ? va - vb : va + vb);
+}
+
+static calc_i128 floor_div(calc_i128 num, calc_i128 den)
+{
+    calc_i128 q = num / den;
+    if (num % den != 0 && num < 0)
+        q--;
+    return q;
+}
+
+static int is_integer(const calc_rat *r)
+{
+    return !r->inexact && r->num % r->den == 0;
+}
+
+static int rat_pow(const calc_rat *a, long long e, calc_rat *r)
+{
+    calc_rat base = *a, acc;
+    int neg = e < 0;
+    unsigned long long n = neg ? 0ULL - (unsigned long long)e : (unsigned long long)e;
+
+    if (neg && a->num == 0)
+        return -1;
+    calc_rat_from_int(&acc, 1);
+    calc_rat_normalize(&base);
+    while (n && !acc.inexact)
+    {
+        if (n & 1)
+            exact_or_inexact(&acc, &base, CALC_OP_MUL, &acc);
+        n >>= 1;
+        if (n)
+            exact_or_inexact(&base, &base, CALC_OP_MUL, &base);
+        if (base.inexact)
+            break;
+    }
+    if (acc.inexact || (n && base.inexact))
+    {
+        set_inexact(r, pow(calc_rat_value(a), (double)e));
+        return 0;
+    }
+    if (neg)
+        set_frac(&acc, acc.den, acc.num);
+    *r = acc;
+    return 0;
+}
+
+int calc_compute_rat(const calc_ctx *ctx, const calc_rat *a, const calc_rat *b, int op, calc_rat *result)
+{
+    calc_rat t;
+
+    if (a->inexact || (b->inexact && !calc_op_is_unary(op)))
+        goto approximate;
+
+    switch (op)
+    {
+        case CALC_OP_ADD:
+        case CALC_OP_SUB:
+        case CALC_OP_MUL:
+            exact_or_inexact(a, b, op, result);
+            return 0;
+        case CALC_OP_DIV:
+            if (b->num == 0) return -1;
+            set_frac(&t, b->den, b->num);
+            exact_or_inexact(a, &t, CALC_OP_MUL, result);
+            return 0;
+        case CALC_OP_PERCENT:
+            /* a/100 * b */
+            set_frac(&t, b->num, b->den);
+            if (__builtin_mul_overflow(t.den, (calc_i128)100, &t.den))
+                goto approximate;
+            exact_or_inexact(a, &t, CALC_OP_MUL, result);
+            return 0;
+        case CALC_OP_MOD:
+        {
+            /* Same as compute(): both operands truncated to integers first */
+            calc_i128 x = a->num / a->den, y = b->num / b->den;
+            if (y == 0) return -1;
+            set_frac(result, x % y, 1);
+            return 0;
+        }
+        case CALC_OP_IDIV:
+        {
+            if (b->num / b->den == 0) return -1;
+            set_frac(&t, b->den, b->num);
+            exact_or_inexact(a, &t, CALC_OP_MUL, &t);
+            if (t.inexact) goto approximate;
+            set_frac(result, floor_div(t.num, t.den), 1);
+            return 0;
+        }
+        case CALC_OP_POW:
+            if (!is_integer(b) || mag(b->num / b->den) > 4096)
+                goto approximate;
+            return rat_pow(a, (long long)(b->num / b->den), result);
+        case CALC_OP_LT: case CALC_OP_LE: case CALC_OP_GT:
+        case CALC_OP_GE: case CALC_OP_EQ: case CALC_OP_NE:
+        {
+            /* Sign of a - b decides every comparison exactly */
+            exact_or_inexact(a, b, CALC_OP_SUB, &t);
+            if (t.inexact) goto approximate;
+            int s = (t.num > 0) - (t.num < 0);
+            int r = (op == CALC_OP_LT) ? s < 0 : (op == CALC_OP_LE) ? s <= 0 : (op == CALC_OP_GT) ? s > 0 :
+                    (op == CALC_OP_GE) ? s >= 0 : (op == CALC_OP_EQ) ? s == 0 : s != 0;
+            set_frac(result, r, 1);
+            return 0;
+        }
+        case CALC_OP_NEG:   set_frac(result, -a->num, a->den); return 0;
+        case CALC_OP_ABS:   set_frac(result, a->num < 0 ? -a->num : a->num, a->den); return 0;
+        case CALC_OP_INV:   if (a->num == 0) return -1; set_frac(result, a->den, a->num); return 0;
+        case CALC_OP_FLOOR: set_frac(result, floor_div(a->num, a->den), 1); return 0;
+        case CALC_OP_CEIL:  set_frac(result, -floor_div(-a->num, a->den), 1); return 0;
+        case CALC_OP_FACT:
+        {
+            if (!is_integer(a) || a->num < 0) return -2;
+            calc_i128 n = a->num / a->den, f = 1;
+            for (calc_i128 i = 2; i <= n; i++)
+                if (__builtin_mul_overflow(f, i, &f))
+                    goto approximate;
+            set_frac(result, f, 1);
+            return 0;
+        }
+        default:
+            break;
+    }
+
+approximate:
+    {
+        double r;
+        int err = calc_compute_op(ctx, calc_rat_value(a), calc_rat_value(b), op, &r);
+        if (err != 0)
+            return err;
+        set_inexact(result, r);
+        return 0;
+    }
+}
+
+int calc_eval_rat(const calc_ctx *ctx, const calc_node *node, calc_rat *result)
+{
+    calc_rat a, b;
+    int err;
+
+    switch (node->kind)
+    {
+        case CALC_NODE_NUM:
+            calc_rat_from_double(result, node->num);
+            return 0;
+        case CALC_NODE_VAR:
+            calc_rat_from_double(result, ctx->var_values[node->var]);
+            return 0;
+        case CALC_NODE_RAND:
+            set_inexact(result, calc_rand_node(ctx, node->op, node->var, ctx->rng_counter));
+            return 0;
+        default:
+            break;
+    }
+    if ((err = calc_eval_rat(ctx, node->a, &a)) != 0)
+        return err;
+    if (node->b && (err = calc_eval_rat(ctx, node->b, &b)) != 0)
+        return err;
+    return calc_compute_rat(ctx, &a, node->b ? &b : &a, node->op, result);
+}
+
+static char *i128_str(calc_i128 x, char *end)
+{
+    u128 m = mag(x);
+    *--end = '\0';
+    do
+    {
+        *--end = (char)('0' + (int)(m % 10));
+        m /= 10;
+    } while (m);
+    if (x < 0)
+        *--end = '-';
+    return end;
+}
+
+int calc_rat_format(const calc_ctx *ctx, const calc_rat *r, char *buf, size_t size)
+{
+    char nbuf[48], dbuf[48];
+    calc_rat t = *r;
+
+    if (t.inexact)
+        return snprintf(buf, size, "~%.*g (inexact)", ctx->precision, t.approx);
+    calc_rat_normalize(&t);
+    if (t.den == 1)
+        return snprintf(buf, size, "%s", i128_str(t.num, nbuf + sizeof(nbuf)));
+    return snprintf(buf, size, "%s/%s = %.*g", i128_str(t.num, nbuf + sizeof(nbuf)),
+                    i128_str(t.den, dbuf + sizeof(dbuf)), ctx->precision, calc_rat_value(&t));
+}
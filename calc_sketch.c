@@ -0,0 +1,379 @@
+/*
+ * Calculator engine - quantile and distinct-count sketches, see calc.h
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include "calc.h"
+
+#define SK_COMPRESSION  500.0   /* t-digest delta: at most delta + 1 centroids */
+#define SK_BLOCKS       16      /* calc_sketch_add_column() splits into this many sketches */
+#define SK_MAGIC        "CSK"
+#define SK_VERSION      1
+
+typedef struct centroid
+{
+    double m, w;
+} centroid;
+
+/* In-place quicksort of doubles (qsort may allocate); recurses on the smaller side */
+static void sort_values(double *v, int n)
+{
+    while (n > 16)
+    {
+        /* Median of three moved to the middle keeps Hoare's partition from stalling */
+        double *a = v, *b = v + n / 2, *c = v + n - 1, t;
+        if (*b < *a) t = *a, *a = *b, *b = t;
+        if (*c < *b) t = *b, *b = *c, *c = t;
+        if (*b < *a) t = *a, *a = *b, *b = t;
+        double pivot = *b;
+        int i = 0, j = n - 1;
+        for (;;)
+        {
+            while (v[i] < pivot) i++;
+            while (v[j] > pivot) j--;
+            if (i >= j)
+                break;
+            t = v[i]; v[i++] = v[j]; v[j--] = t;
+        }
+        if (j + 1 < n - j - 1)
+        {
+            sort_values(v, j + 1);
+            v += j + 1;
+            n -= j + 1;
+        }
+        else
+        {
+            sort_values(v + j + 1, n - j - 1);
+            n = j + 1;
+        }
+    }
+    for (int i = 1; i < n; i++)
+    {
+        double x = v[i];
+        int j = i;
+        for (; j > 0 && v[j - 1] > x; j--)
+            v[j] = v[j - 1];
+        v[j] = x;
+    }
+}
+
+/* Merges two mean-sorted centroid lists; values are single points of weight 1 */
+static int merge_lists(const double *am, const double *aw, int na, const double *values, int nv, centroid *out)
+{
+    int i = 0, j = 0, n = 0;
+    while (i < na || j < nv)
+    {
+        if (j == nv || (i < na && am[i] <= values[j]))
+            out[n].m = am[i], out[n++].w = aw[i++];
+        else
+            out[n].m = values[j++], out[n++].w = 1;
+    }
+    return n;
+}
+
+/* Largest cumulative fraction a centroid starting at q0 may reach (k1 scale function) */
+static double q_limit(double q0)
+{
+    double k = SK_COMPRESSION / (2 * CALC_PI) * asin(2 * q0 - 1) + 1;
+    if (k >= SK_COMPRESSION / 4)
+        return 1;
+    return (sin(k * 2 * CALC_PI / SK_COMPRESSION) + 1) / 2;
+}
+
+/*
+ * Merging t-digest pass over the mean-sorted list all: merges neighbours
+ * greedily while each centroid spans at most one unit of the scale function,
+ * writing the result to s.
+ */
+static void rebuild(calc_sketch *s, const centroid *all, int n)
+{
+    double total = 0;
+    for (int i = 0; i < n; i++)
+        total += all[i].w;
+
+    double done = 0, limit = q_limit(0) * total;
+    centroid cur = all[0];
+    int out = 0;
+    for (int i = 1; i < n; i++)
+    {
+        if (done + cur.w + all[i].w <= limit)
+        {
+            cur.w += all[i].w;
+            cur.m += (all[i].m - cur.m) * all[i].w / cur.w;
+            continue;
+        }
+        s->mean[out] = cur.m;
+        s->weight[out++] = cur.w;
+        done += cur.w;
+        limit = q_limit(done / total) * total;
+        cur = all[i];
+    }
+    s->mean[out] = cur.m;
+    s->weight[out++] = cur.w;
+    s->centroids = out;
+}
+
+/* Folds the buffered points into the centroids */
+static void flush(calc_sketch *s)
+{
+    centroid all[CALC_SKETCH_CENTROIDS + CALC_SKETCH_BUFFER];
+
+    if (s->buffered == 0)
+        return;
+    sort_values(s->buffer, s->buffered);
+    int n = merge_lists(s->mean, s->weight, s->centroids, s->buffer, s->buffered, all);
+    s->buffered = 0;
+    rebuild(s, all, n);
+}
+
+/* splitmix64 finalizer: every input bit affects every output bit */
+static uint64_t mix64(uint64_t h)
+{
+    h ^= h >> 30;
+    h *= 0xBF58476D1CE4E5B9ull;
+    h ^= h >> 27;
+    h *= 0x94D049BB133111EBull;
+    h ^= h >> 31;
+    return h;
+}
+
+void calc_sketch_init(calc_sketch *s)
+{
+    memset(s, 0, sizeof(*s));
+    s->min = INFINITY;
+    s->max = -INFINITY;
+}
+
+void calc_sketch_add(calc_sketch *s, double x)
+{
+    uint64_t bits;
+
+    if (isnan(x))
+        return;
+    if (x == 0)
+        x = 0;  /* -0 and 0 are the same value */
+
+    s->count++;
+    if (x < s->min) s->min = x;
+    if (x > s->max) s->max = x;
+    s->buffer[s->buffered++] = x;
+    if (s->buffered == CALC_SKETCH_BUFFER)
+        flush(s);
+
+    /* HyperLogLog: top bits pick the register, the rest give the rank */
+    memcpy(&bits, &x, sizeof(bits));
+    bits = mix64(bits);
+    unsigned reg = (unsigned)(bits >> (64 - CALC_SKETCH_HLL_BITS));
+    uint64_t rest = bits << CALC_SKETCH_HLL_BITS;
+    unsigned char rank = rest ? (unsigned char)(__builtin_clzll(rest) + 1)
+                              : (unsigned char)(64 - CALC_SKETCH_HLL_BITS + 1);
+    if (rank > s->hll[reg])
+        s->hll[reg] = rank;
+}
+
+void calc_sketch_merge(calc_sketch *dst, const calc_sketch *src)
+{
+    double values[CALC_SKETCH_BUFFER];
+    centroid part[CALC_SKETCH_CENTROIDS + CALC_SKETCH_BUFFER];
+    centroid all[2 * CALC_SKETCH_CENTROIDS + CALC_SKETCH_BUFFER];
+
+    if (src->count == 0)
+        return;
+    flush(dst);
+
+    /* Both centroid lists are already sorted; only src's buffer needs sorting */
+    memcpy(values, src->buffer, src->buffered * sizeof(double));
+    sort_values(values, src->buffered);
+    int np = merge_lists(src->mean, src->weight, src->centroids, values, src->buffered, part);
+    int i = 0, j = 0, n = 0;
+    while (i < dst->centroids || j < np)
+    {
+        if (j == np || (i < dst->centroids && dst->mean[i] <= part[j].m))
+            all[n].m = dst->mean[i], all[n++].w = dst->weight[i++];
+        else
+            all[n++] = part[j++];
+    }
+    rebuild(dst, all, n);
+
+    dst->count += src->count;
+    if (src->min < dst->min) dst->min = src->min;
+    if (src->max > dst->max) dst->max = src->max;
+    for (int k = 0; k < CALC_SKETCH_HLL_REGS; k++)
+        if (src->hll[k] > dst->hll[k])
+            dst->hll[k] = src->hll[k];
+}
+
+void calc_sketch_add_column(calc_sketch *s, const double *x, size_t n)
+{
+    if (n < SK_BLOCKS * CALC_SKETCH_BUFFER)
+    {
+        for (size_t i = 0; i < n; i++)
+            calc_sketch_add(s, x[i]);
+        return;
+    }
+
+    /* One private sketch per block, merged in block order */
+#ifdef _OPENMP
+    #pragma omp parallel for ordered schedule(static, 1)
+#endif
+    for (int blk = 0; blk < SK_BLOCKS; blk++)
+    {
+        calc_sketch local;
+        size_t first = n / SK_BLOCKS * blk, last = (blk == SK_BLOCKS - 1) ? n : first + n / SK_BLOCKS;
+
+        calc_sketch_init(&local);
+        for (size_t i = first; i < last; i++)
+            calc_sketch_add(&local, x[i]);
+#ifdef _OPENMP
+        #pragma omp ordered
+#endif
+        calc_sketch_merge(s, &local);
+    }
+}
+
+int calc_sketch_quantile(calc_sketch *s, double q, double *result)
+{
+    if (s->count == 0 || !(q >= 0 && q <= 1))
+        return -2;
+    if (s->buffered)
+        flush(s);
+
+    /* Interpolate between centroid centres; the ends run out to min and max */
+    double target = q * s->count, cum = 0;
+    int last = s->centroids - 1;
+    if (target <= s->weight[0] / 2)
+    {
+        double half = s->weight[0] / 2;
+        *result = (half > 0.5) ? s->min + (s->mean[0] - s->min) * target / half : s->mean[0];
+        return 0;
+    }
+    if (target >= s->count - s->weight[last] / 2)
+    {
+        double half = s->weight[last] / 2;
+        *result = (half > 0.5) ? s->max - (s->max - s->mean[last]) * (s->count - target) / half
+                               : s->mean[last];
+        return 0;
+    }
+    for (int i = 0; i < last; i++)
+    {
+        double gap = (s->weight[i] + s->weight[i + 1]) / 2;
+        double centre = cum + s->weight[i] / 2;
+        if (target < centre + gap)
+        {
+            *result = s->mean[i] + (s->mean[i + 1] - s->mean[i]) * (target - centre) / gap;
+            return 0;
+        }
+        cum += s->weight[i];
+    }
+    *result = s->mean[last];
+    return 0;
+}
+
+double calc_sketch_distinct(const calc_sketch *s)
+{
+    const double m = CALC_SKETCH_HLL_REGS;
+    double sum = 0;
+    int zeros = 0;
+
+    for (int i = 0; i < CALC_SKETCH_HLL_REGS; i++)
+    {
+        sum += ldexp(1.0, -s->hll[i]);
+        zeros += (s->hll[i] == 0);
+    }
+    double est = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+    /* Linear counting is more accurate while many registers are still empty */
+    if (est <= 2.5 * m && zeros > 0)
+        est = m * log(m / zeros);
+    return (s->count < est) ? s->count : est;
+}
+
+/* Serialized layout (little-endian): "CSK", version, count, min, max,
+   centroid count, centroids as (mean, weight), HLL registers. */
+static unsigned char *put_u64(unsigned char *p, uint64_t v)
+{
+    for (int i = 0; i < 8; i++)
+        *p++ = (unsigned char)(v >> (8 * i));
+    return p;
+}
+
+static unsigned char *put_f64(unsigned char *p, double v)
+{
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    return put_u64(p, bits);
+}
+
+static const unsigned char *get_u64(const unsigned char *p, uint64_t *v)
+{
+    *v = 0;
+    for (int i = 0; i < 8; i++)
+        *v |= (uint64_t)p[i] << (8 * i);
+    return p + 8;
+}
+
+static const unsigned char *get_f64(const unsigned char *p, double *v)
+{
+    uint64_t bits;
+    p = get_u64(p, &bits);
+    memcpy(v, &bits, sizeof(*v));
+    return p;
+}
+
+size_t calc_sketch_save(calc_sketch *s, void *buf, size_t size)
+{
+    if (s->buffered)
+        flush(s);
+
+    size_t need = 4 + 8 * 4 + 16 * (size_t)s->centroids + CALC_SKETCH_HLL_REGS;
+    if (size < need)
+        return 0;
+
+    unsigned char *p = buf;
+    memcpy(p, SK_MAGIC, 3);
+    p[3] = SK_VERSION;
+    p = put_f64(p + 4, s->count);
+    p = put_f64(p, s->min);
+    p = put_f64(p, s->max);
+    p = put_u64(p, (uint64_t)s->centroids);
+    for (int i = 0; i < s->centroids; i++)
+    {
+        p = put_f64(p, s->mean[i]);
+        p = put_f64(p, s->weight[i]);
+    }
+    memcpy(p, s->hll, CALC_SKETCH_HLL_REGS);
+    return need;
+}
+
+int calc_sketch_load(calc_sketch *s, const void *buf, size_t size)
+{
+    const unsigned char *p = buf;
+    uint64_t n;
+
+    if (size < 4 + 8 * 4 || memcmp(p, SK_MAGIC, 3) != 0 || p[3] != SK_VERSION)
+        return 2;
+    calc_sketch_init(s);
+    p = get_f64(p + 4, &s->count);
+    p = get_f64(p, &s->min);
+    p = get_f64(p, &s->max);
+    p = get_u64(p, &n);
+    if (n > CALC_SKETCH_CENTROIDS || size != 4 + 8 * 4 + 16 * n + CALC_SKETCH_HLL_REGS)
+        return 2;
+    /* A nonempty sketch without centroids would send quantile() to weight[-1] */
+    if (!(s->count >= 0) || (n == 0) != (s->count == 0))
+        return 2;
+    s->centroids = (int)n;
+    for (int i = 0; i < s->centroids; i++)
+    {
+        p = get_f64(p, &s->mean[i]);
+        p = get_f64(p, &s->weight[i]);
+        if (!(s->weight[i] > 0))
+            return 2;
+    }
+    memcpy(s->hll, p, CALC_SKETCH_HLL_REGS);
+    for (int i = 0; i < CALC_SKETCH_HLL_REGS; i++)
+        if (s->hll[i] > 64 - CALC_SKETCH_HLL_BITS + 1)
+            return 2;
+    return 0;
+}
@@ -0,0 +1,172 @@
+/*
+ * Calculator engine - bracketed root finding, see calc.h
+ */
+
+#include <math.h>
+#include <float.h>
+#include "calc.h"
+
+#define SOLVE_MAX_ITER 200
+
+/*
+ * Relative to x, plus an absolute floor from the starting bracket width: a root
+ * at 0 has no useful relative tolerance, and x^3 and other multiple roots only
+ * converge linearly towards it.
+ */
+static double tolerance(double x, double width)
+{
+    return 4 * DBL_EPSILON * fabs(x) + DBL_EPSILON * width + 1e-300;
+}
+
+static int eval_at(calc_ctx *c, const calc_prog *prog, int var, double x, double *fx)
+{
+    c->var_values[var] = x;
+    return calc_run(c, prog, fx);
+}
+
+int calc_solve_newton(const calc_ctx *ctx, const calc_prog *prog, int var, double lo, double hi, double *root)
+{
+    double flo, fhi, fx, dfx;
+    calc_ctx c = *ctx;
+    int err;
+
+    if ((err = eval_at(&c, prog, var, lo, &flo)) != 0 || (err = eval_at(&c, prog, var, hi, &fhi)) != 0)
+        return err;
+    if (flo == 0) { *root = lo; return 0; }
+    if (fhi == 0) { *root = hi; return 0; }
+    if ((flo > 0) == (fhi > 0))
+        return 6;
+    if (flo > 0)
+    {
+        /* Orient the bracket so that f(lo) < 0 < f(hi) */
+        double t = lo; lo = hi; hi = t;
+    }
+
+    double width = fabs(hi - lo);
+    double x = 0.5 * (lo + hi);
+    for (int it = 0; it < SOLVE_MAX_ITER; it++)
+    {
+        if ((err = calc_run_dual(&c, prog, var, x, &fx, &dfx)) != 0)
+            return err;
+        if (fx == 0) { *root = x; return 0; }
+        if (fx < 0) lo = x; else hi = x;
+
+        /* Newton step when it lands inside the bracket, bisection otherwise */
+        double next = x - fx / dfx;
+        if (!isfinite(next) || (next - lo) * (next - hi) >= 0)
+            next = 0.5 * (lo + hi);
+        if (fabs(next - x) <= tolerance(x, width) || fabs(hi - lo) <= tolerance(x, width))
+        {
+            *root = next;
+            return 0;
+        }
+        x = next;
+    }
+    return 5;
+}
+
+int calc_solve_brent(const calc_ctx *ctx, const calc_prog *prog, int var, double lo, double hi, double *root)
+{
+    double a = lo, b = hi, c, d, e, fa, fb, fc;
+    calc_ctx cx = *ctx;
+    int err;
+
+    if ((err = eval_at(&cx, prog, var, a, &fa)) != 0 || (err = eval_at(&cx, prog, var, b, &fb)) != 0)
+        return err;
+    if (fa == 0) { *root = a; return 0; }
+    if (fb == 0) { *root = b; return 0; }
+    if ((fa > 0) == (fb > 0))
+        return 6;
+
+    double width = fabs(b - a);
+    c = a; fc = fa;
+    d = e = b - a;
+    for (int it = 0; it < SOLVE_MAX_ITER; it++)
+    {
+        if ((fb > 0) == (fc > 0))
+        {
+            c = a; fc = fa;
+            d = e = b - a;
+        }
+        if (fabs(fc) < fabs(fb))
+        {
+            /* Keep b as the best estimate */
+            a = b; b = c; c = a;
+            fa = fb; fb = fc; fc = fa;
+        }
+
+        double tol = tolerance(b, width);
+        double m = 0.5 * (c - b);
+        if (fabs(m) <= tol || fb == 0)
+        {
+            *root = b;
+            return 0;
+        }
+
+        if (fabs(e) >= tol && fabs(fa) > fabs(fb))
+        {
+            /* Inverse quadratic interpolation, or secant when only two points differ */
+            double p, q, r, s = fb / fa;
+            if (a == c)
+            {
+                p = 2 * m * s;
+                q = 1 - s;
+            }
+            else
+            {
+                q = fa / fc;
+                r = fb / fc;
+                p = s * (2 * m * q * (q - r) - (b - a) * (r - 1));
+                q = (q - 1) * (r - 1) * (s - 1);
+            }
+            if (p > 0) q = -q; else p = -p;
+            if (2 * p < 3 * m * q - fabs(tol * q) && p < fabs(0.5 * e * q))
+            {
+                e = d;
+                d = p / q;
+            }
+            else
+                d = e = m;
+        }
+        else
+            d = e = m;
+
+        a = b; fa = fb;
+        b += (fabs(d) > tol) ? d : (m > 0 ? tol : -tol);
+        if ((err = eval_at(&cx, prog, var, b, &fb)) != 0)
+            return err;
+    }
+    return 5;
+}
+
+int calc_solve(const calc_ctx *ctx, const calc_prog *prog, int var, double lo, double hi, double *root)
+{
+    int err = calc_solve_newton(ctx, prog, var, lo, hi, root);
+    if (err == 5)
+        err = calc_solve_brent(ctx, prog, var, lo, hi, root);
+    return err;
+}
+
+size_t calc_solve_batch(const calc_ctx *ctx, const calc_prog *prog, int var, int param,
+                        const double *params, double *roots, int *status, size_t n,
+                        double lo, double hi)
+{
+    long failed = 0;
+
+    /* Every equation gets its own context copy, so iterations share nothing */
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic, 64) reduction(+:failed)
+#endif
+    for (long i = 0; i < (long)n; i++)
+    {
+        calc_ctx c = *ctx;
+        c.var_values[param] = params[i];
+        status[i] = calc_solve(&c, prog, var, lo, hi, &roots[i]);
+        if (status[i] != 0)
+        {
+            roots[i] = NAN;
+            failed++;
+        }
+    }
+    return (size_t)failed;
+}
@@ -0,0 +1,616 @@
+/*
+ * Calculator engine - regression checks for the library, see calc.h
+ * Build: gcc -O2 calc_test.c calc.c calc_expr.c calc_prog.c calc_solve.c calc_quad.c calc_rand.c
+ *        calc_rat.c calc_sketch.c calc_pipe.c calc_poly.c -o calc_test -lm
+ * Prints each failed check and exits with 1 if any failed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+#include "calc.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { if (!(cond)) { printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+static char arena_buf[64 * 1024];
+
+/* Parses and compiles text against the variables already in ctx */
+static int compile(calc_ctx *ctx, const char *text, calc_prog *prog)
+{
+    calc_arena arena;
+    calc_node *tree;
+    size_t pos;
+
+    calc_arena_init(&arena, arena_buf, sizeof(arena_buf));
+    if (calc_parse(ctx, &arena, text, &tree, &pos) != 0)
+        return -1;
+    return calc_compile(tree, prog);
+}
+
+/* Pair operators, formulas and the split-array batch all give complex results */
+static void test_complex(void)
+{
+    calc_ctx ctx;
+    calc_arena arena;
+    calc_node *tree;
+    calc_prog prog;
+    double complex z;
+    double re[13], im[13], out_re[13], out_im[13], r;
+    size_t pos;
+
+    calc_init(&ctx);
+    calc_set_var(&ctx, "x", 2);
+    CHECK(calc_compute_complex(&ctx, -1, 0, "sqrt", &z) == 0 && z == I);
+    CHECK(calc_compute_complex(&ctx, -2, 0, "ln", &z) == 0 && creal(z) == log(2.0) && cimag(z) == CALC_PI);
+    CHECK(calc_compute_complex(&ctx, 2, 0, "asin", &z) == 0 && cimag(z) != 0);
+    CHECK(calc_compute_complex(&ctx, 1 + 2 * I, 3 - I, "*", &z) == 0 && z == 5 + 5 * I);
+    CHECK(calc_compute_complex(&ctx, 1, 0, "/", &z) == -1 && calc_compute_complex(&ctx, 2 * I, 0, "inv", &z) == 0);
+    CHECK(calc_compute_complex(&ctx, 0, 0, "inv", &z) == -1 && calc_compute_complex(&ctx, I, 0, "fact", &z) == -2);
+
+    calc_arena_init(&arena, arena_buf, sizeof(arena_buf));
+    CHECK(calc_parse(&ctx, &arena, "sqrt(-4) + 3i*x - conj(i)", &tree, &pos) == 0);
+    CHECK(calc_eval_complex(&ctx, tree, &z) == 0 && z == 9 * I);
+    CHECK(calc_parse(&ctx, &arena, "x + 3i", &tree, &pos) == 0);
+    CHECK(calc_eval(&ctx, tree, &r) == 1);  /* imaginary literals have no real value */
+    CHECK(calc_parse(&ctx, &arena, "2ix", &tree, &pos) == 2);
+
+    /* Batch lanes match the tree walk, including the partial last block and a failing lane */
+    CHECK(compile(&ctx, "(x + 1i)^2 / (x - 2) + exp(i*x) - sqrt(-x)", &prog) == 0);
+    calc_arena_init(&arena, arena_buf, sizeof(arena_buf));
+    calc_parse(&ctx, &arena, "(x + 1i)^2 / (x - 2) + exp(i*x) - sqrt(-x)", &tree, &pos);
+    for (int k = 0; k < 13; k++)
+    {
+        re[k] = k * 0.5 - 2;
+        im[k] = (k % 3) - 1;
+    }
+    im[8] = 0;  /* x = 2: division by zero */
+    CHECK(calc_run_batch_complex(&ctx, &prog, calc_var_index(&ctx, "x"), re, im, out_re, out_im, 13) == 1);
+    for (int k = 0; k < 13; k++)
+    {
+        calc_ctx c = ctx;
+        int err;
+        if (im[k] != 0)
+        {
+            /* Variables are real, so complex inputs are checked against C arithmetic */
+            double complex x = re[k] + im[k] * I;
+            z = cpow(x + I, 2) / (x - 2) + cexp(I * x) - csqrt(-x);
+            CHECK(cabs(out_re[k] + out_im[k] * I - z) <= 1e-14 * cabs(z));
+            continue;
+        }
+        c.var_values[0] = re[k];
+        err = calc_eval_complex(&c, tree, &z);
+        CHECK(err == (k == 8 ? -1 : 0));
+        CHECK(err != 0 ? isnan(out_re[k]) : out_re[k] == creal(z) && out_im[k] == cimag(z));
+    }
+}
+
+/* Dual-number gradients agree with central differences along every seeded variable */
+static void test_grad(void)
+{
+    static const char *const formulas[] = {
+        "x^2*sin(y) + exp(x/y) - sqrt(x*y)",
+        "atan(x - y)*cosh(y) + log(x + 3) / tanh(y) - x^y",
+        "p(3, x) + x // 1 + abs(x - 2*y) + inv(y) + fact(3)*y",
+    };
+    calc_ctx ctx;
+    calc_prog prog;
+    calc_dual r;
+    int vars[CALC_DUAL_N];
+    double fx, dfx;
+
+    calc_init(&ctx);
+    calc_set_var(&ctx, "x", 1.3);
+    calc_set_var(&ctx, "y", 0.7);
+    for (size_t f = 0; f < sizeof(formulas) / sizeof(formulas[0]); f++)
+    {
+        CHECK(compile(&ctx, formulas[f], &prog) == 0);
+        int n = calc_prog_vars(&prog, vars, CALC_DUAL_N);
+        CHECK(n == 2 && calc_run_grad(&ctx, &prog, vars, n, &r) == 0);
+        for (int k = 0; k < n; k++)
+        {
+            calc_ctx c = ctx;
+            double h = 1e-6, hi, lo;
+            c.var_values[vars[k]] += h;
+            calc_run(&c, &prog, &hi);
+            c.var_values[vars[k]] -= 2 * h;
+            calc_run(&c, &prog, &lo);
+            double fd = (hi - lo) / (2 * h);
+            CHECK(fabs(r.d[k] - fd) <= 1e-6 * (1 + fabs(fd)));
+        }
+        CHECK(calc_run_dual(&ctx, &prog, vars[0], ctx.var_values[vars[0]], &fx, &dfx) == 0);
+        CHECK(fx == r.v && dfx == r.d[0]);
+    }
+    CHECK(compile(&ctx, "2 + 3", &prog) == 0 && calc_prog_vars(&prog, vars, CALC_DUAL_N) == 0);
+    CHECK(calc_run_grad(&ctx, &prog, vars, 0, &r) == 0 && r.v == 5);
+    CHECK(calc_run_grad(&ctx, &prog, vars, CALC_DUAL_N + 1, &r) == 4);
+}
+
+/* A tiered formula gives the tree walk's results, errors included, before and after it compiles */
+static void test_solve(void)
+{
+    calc_ctx ctx;
+    calc_prog prog;
+    double root, params[5] = {1, 2, 25, -1, 0.25}, roots[5];
+    int status[5];
+
+    calc_init(&ctx);
+    calc_set_var(&ctx, "x", 0);
+    calc_set_var(&ctx, "a", 0);
+    int x = calc_var_index(&ctx, "x");
+    CHECK(compile(&ctx, "x^2 - 2", &prog) == 0);
+    CHECK(calc_solve(&ctx, &prog, x, 0, 2, &root) == 0 && fabs(root - sqrt(2.0)) <= 4e-16);
+    CHECK(calc_solve_brent(&ctx, &prog, x, 2, 0, &root) == 0 && fabs(root - sqrt(2.0)) <= 1e-15);
+    CHECK(calc_solve(&ctx, &prog, x, 2, 3, &root) == 6);
+
+    /* A triple root converges only linearly and has no relative tolerance at 0 */
+    CHECK(compile(&ctx, "x^3", &prog) == 0);
+    CHECK(calc_solve(&ctx, &prog, x, -1, 2, &root) == 0 && fabs(root) <= 1e-14);
+    CHECK(calc_solve_newton(&ctx, &prog, x, -1, 2, &root) == 0 && fabs(root) <= 1e-14);
+    CHECK(calc_solve_brent(&ctx, &prog, x, -1, 2, &root) == 0 && fabs(root) <= 1e-14);
+    CHECK(compile(&ctx, "(x - 1)^2", &prog) == 0 && calc_solve(&ctx, &prog, x, 0, 3, &root) == 6);
+    CHECK(compile(&ctx, "ln(x)", &prog) == 0 && calc_solve(&ctx, &prog, x, -1, 3, &root) == -2);
+
+    CHECK(compile(&ctx, "x^2 - a", &prog) == 0);
+    CHECK(calc_solve_batch(&ctx, &prog, x, calc_var_index(&ctx, "a"), params, roots, status, 5, 0, 4) == 2);
+    for (int i = 0; i < 5; i++)
+    {
+        if (params[i] > 0 && params[i] <= 16)
+            CHECK(status[i] == 0 && fabs(roots[i] - sqrt(params[i])) <= 1e-15 * sqrt(params[i]) + 1e-15);
+        else
+            CHECK(status[i] == 6 && isnan(roots[i]));
+    }
+}
+
+static void test_formula_tiers(void)
+{
+    calc_ctx ctx;
+    calc_arena arena;
+    calc_node *tree;
+    calc_formula f;
+    size_t pos;
+
+    calc_init(&ctx);
+    calc_set_var(&ctx, "x", 0);
+    calc_arena_init(&arena, arena_buf, sizeof(arena_buf));
+    CHECK(calc_parse(&ctx, &arena, "-(x - 3)^3 / (x - 7) + sin(x)*rand() + (x >= 10) - ln(abs(x - 12))", &tree, &pos) == 0);
+    calc_formula_init(&f, tree);
+    /* x = 7 fails before the formula compiles, x = 12 after */
+    for (int i = 0; i < 2 * CALC_HOT_CALLS; i++)
+    {
+        double walked = 0, tiered = 0;
+        ctx.var_values[0] = i * 0.125;
+        ctx.rng_counter = i;
+        int err = calc_eval(&ctx, tree, &walked);
+        CHECK(calc_formula_eval(&ctx, &f, &tiered) == err);
+        CHECK(err != 0 || tiered == walked);
+        CHECK(f.compiled == (i + 1 >= CALC_HOT_CALLS));
+    }
+}
+
+/* Sums and integrals of rand() draw fresh samples per range, reproducibly */
+static void test_sum(void)
+{
+    calc_ctx ctx;
+    calc_prog prog;
+    double r;
+    long long bad = 0;
+
+    calc_init(&ctx);
+    calc_set_var(&ctx, "k", 0);
+    int k = calc_var_index(&ctx, "k");
+    CHECK(compile(&ctx, "k", &prog) == 0);
+    CHECK(calc_sum(&ctx, &prog, k, 1, 100, &r, NULL) == 0 && r == 5050);
+    CHECK(calc_sum(&ctx, &prog, k, -1000000, 1000000, &r, NULL) == 0 && r == 0);
+    CHECK(calc_sum(&ctx, &prog, k, 5, 4, &r, NULL) == 0 && r == 0);
+    CHECK(calc_sum(&ctx, &prog, k, -9000000000000000000LL, 9000000000000000000LL, &r, NULL) == 4);
+    CHECK(calc_sum(&ctx, &prog, k, LLONG_MIN, LLONG_MAX, &r, NULL) == 4);
+    CHECK(calc_sum(&ctx, &prog, k, 0, (long long)CALC_SUM_MAX, &r, NULL) == 4);
+
+    /* The lowest failing term is reported with its own error code */
+    CHECK(compile(&ctx, "1/k", &prog) == 0 && calc_sum(&ctx, &prog, k, 0, 5, &r, &bad) == -1 && bad == 0);
+    CHECK(compile(&ctx, "ln(k - 3)", &prog) == 0 && calc_sum(&ctx, &prog, k, 1, 9, &r, &bad) == -2 && bad == 1);
+    CHECK(compile(&ctx, "1/((k - 3000)*(k - 1500))", &prog) == 0);
+    CHECK(calc_sum(&ctx, &prog, k, 1, 5000, &r, &bad) == -1 && bad == 1500);
+}
+
+/* Monte Carlo estimates depend on the seed only: not on the thread count or block split */
+static void test_montecarlo_seed(void)
+{
+    calc_ctx ctx, other;
+    calc_prog prog;
+    double m1, v1, m2, v2, f, sum = 0, sum2 = 0;
+    const long long n = 100003;
+
+    calc_init(&ctx);
+    ctx.rng_seed = 12345;
+    ctx.rng_counter = 77;
+    CHECK(compile(&ctx, "4*(rand()^2 + rand()^2 <= 1)", &prog) == 0);
+    CHECK(calc_montecarlo(&ctx, &prog, n, &m1, &v1) == 0);
+    CHECK(calc_montecarlo(&ctx, &prog, n, &m2, &v2) == 0);
+    CHECK(m1 == m2 && v1 == v2);
+    CHECK(fabs(m1 - CALC_PI) < 0.05);
+
+    other = ctx;
+    other.rng_seed = 12346;
+    CHECK(calc_montecarlo(&other, &prog, n, &m2, &v2) == 0);
+    CHECK(m1 != m2 && fabs(m2 - CALC_PI) < 0.05);
+
+    /* Sample i is sample rng_counter + i of a plain serial loop */
+    other = ctx;
+    for (long long i = 0; i < n; i++)
+    {
+        other.rng_counter = ctx.rng_counter + (unsigned long long)i;
+        calc_run(&other, &prog, &f);
+        sum += f;
+        sum2 += f * f;
+    }
+    CHECK(fabs(m1 - sum / n) <= 1e-12);
+    CHECK(fabs(v1 - (sum2 - sum * sum / n) / (n - 1)) <= 1e-9);
+
+#ifdef _OPENMP
+    int threads = omp_get_max_threads();
+    omp_set_num_threads(1);
+    CHECK(calc_montecarlo(&ctx, &prog, n, &m2, &v2) == 0 && m1 == m2 && v1 == v2);
+    omp_set_num_threads(4);
+    CHECK(calc_montecarlo(&ctx, &prog, n, &m2, &v2) == 0 && m1 == m2 && v1 == v2);
+    omp_set_num_threads(threads);
+#endif
+}
+
+static void test_rand_ranges(void)
+{
+    calc_ctx ctx;
+    calc_prog prog;
+    double lo, hi, all, again, i1, i2, e;
+
+    calc_init(&ctx);
+    calc_set_var(&ctx, "k", 0);
+    calc_set_var(&ctx, "x", 0);
+    CHECK(compile(&ctx, "rand()", &prog) == 0);
+
+    CHECK(calc_sum(&ctx, &prog, calc_var_index(&ctx, "k"), 1, 64, &lo, NULL) == 0);
+    CHECK(calc_sum(&ctx, &prog, calc_var_index(&ctx, "k"), 65, 128, &hi, NULL) == 0);
+    CHECK(calc_sum(&ctx, &prog, calc_var_index(&ctx, "k"), 1, 128, &all, NULL) == 0);
+    CHECK(calc_sum(&ctx, &prog, calc_var_index(&ctx, "k"), 65, 128, &again, NULL) == 0);
+    CHECK(lo != hi);
+    CHECK(hi == again);
+    CHECK(all > lo + hi - 1e-12 && all < lo + hi + 1e-12);
+
+    calc_integrate(&ctx, &prog, calc_var_index(&ctx, "x"), 0, 1, 1e-10, &i1, &e);
+    calc_integrate(&ctx, &prog, calc_var_index(&ctx, "x"), 0, 1, 1e-10, &i2, &e);
+    CHECK(i1 == i2);
+    CHECK(i1 > 0.4 && i1 < 0.6);
+}
+
+/* Doubles whose short decimal form does not round-trip convert exactly, either sign */
+/* Comparisons, including one at the very end of the text, and no chaining */
+static void test_compare_parse(void)
+{
+    static const struct { const char *text; int err; double value; } cases[] = {
+        { "3 < 4", 0, 1 }, { "4 < 3", 0, 0 }, { "3 <= 3", 0, 1 }, { "3 >= 3.5", 0, 0 },
+        { "2 > 1", 0, 1 }, { "3 == 3", 0, 1 }, { "3 == 2 + 1.5", 0, 0 }, { "3 != 3", 0, 0 },
+        { "x != 2", 0, 1 }, { "x*2<=x+x", 0, 1 }, { "(1 < 2) + (2 < 1)", 0, 1 },
+        { "3 <", 2, 0 }, { "3 <=", 2, 0 }, { "3 ==", 2, 0 }, { "3 !=", 2, 0 }, { "3 >", 2, 0 },
+        { "3 = 3", 2, 0 }, { "3 =", 2, 0 }, { "1 < 2 < 3", 2, 0 }, { "1 == 1 != 0", 2, 0 },
+    };
+    calc_ctx ctx;
+    calc_arena arena;
+    calc_node *tree;
+    size_t pos;
+    double r;
+
+    calc_init(&ctx);
+    calc_set_var(&ctx, "x", 5);
+    calc_arena_init(&arena, arena_buf, sizeof(arena_buf));
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        calc_arena_reset(&arena);
+        int err = calc_parse(&ctx, &arena, cases[i].text, &tree, &pos);
+        CHECK(err == cases[i].err);
+        if (err == 0)
+            CHECK(calc_eval(&ctx, tree, &r) == 0 && r == cases[i].value);
+    }
+}
+
+/* Fused pipelines give what running the stages one after another would */
+static void test_pipe(void)
+{
+    static double x[100000], out[100000];
+    static calc_pipe pipe;
+    calc_ctx ctx;
+    calc_arena arena;
+    size_t pos = 0, kept = 0;
+    double sum = 0, r;
+    int n = 100000;
+
+    calc_init(&ctx);
+    calc_set_var(&ctx, "x", 0);
+    int var = calc_var_index(&ctx, "x");
+    calc_arena_init(&arena, arena_buf, sizeof(arena_buf));
+    for (int i = 0; i < n; i++)
+        x[i] = i - 500;
+
+    CHECK(calc_pipe_parse(&ctx, &arena, "map x*2 | filter x > 3 | map sqrt(x) | reduce +", var, &pipe, &pos) == 0);
+    CHECK(calc_pipe_push(&ctx, &pipe, x, 1000, NULL) == 0);
+    CHECK(calc_pipe_push(&ctx, &pipe, x + 1000, n - 1000, NULL) == 0);
+    for (int i = 0; i < n; i++)
+        if (x[i] * 2 > 3)
+            sum += sqrt(x[i] * 2);
+    CHECK(calc_pipe_result(&pipe, &r) == 0 && fabs(r - sum) <= 1e-12 * sum);
+
+    /* Without reduce the survivors come back in order; a failed map gives NaN, which filter drops */
+    CHECK(calc_pipe_parse(&ctx, &arena, "map 1/(x - 7) | filter x == x", var, &pipe, &pos) == 0);
+    CHECK(calc_pipe_push(&ctx, &pipe, x, n, out) == (size_t)n - 1);
+    for (int i = 0; i < n; i++)
+        if (x[i] != 7)
+            CHECK(out[kept++] == 1 / (x[i] - 7));
+
+    CHECK(calc_pipe_parse(&ctx, &arena, "filter x > 1e9 | reduce max", var, &pipe, &pos) == 1);
+    CHECK(calc_pipe_parse(&ctx, &arena, "filter x > 1e9 | reduce -", var, &pipe, &pos) == 0);
+    calc_pipe_push(&ctx, &pipe, x, n, NULL);
+    CHECK(calc_pipe_result(&pipe, &r) == -2);
+    CHECK(calc_pipe_parse(&ctx, &arena, "map x |", var, &pipe, &pos) == 2);
+    CHECK(calc_pipe_parse(&ctx, &arena, "reduce + | map x", var, &pipe, &pos) == 2);
+    CHECK(calc_pipe_parse(&ctx, &arena, "frob x", var, &pipe, &pos) == 1);
+    CHECK(calc_pipe_parse(&ctx, &arena, "map x <", var, &pipe, &pos) == 2 && pos == 7);
+}
+
+/* Exact fractions stay exact until they overflow, then carry a double */
+static void test_rat_exact(void)
+{
+    calc_ctx ctx;
+    calc_rat a, b, r;
+    char out[128];
+    calc_i128 max = (calc_i128)(~(unsigned __int128)0 >> 1);
+
+    calc_init(&ctx);
+    CHECK(calc_rat_parse("170141183460469231731687303715884105727", &r) == 0 && !r.inexact && r.num == max);
+    CHECK(calc_rat_parse("170141183460469231731687303715884105729", &r) == 0 && r.inexact && r.approx > 1.7e38);
+    CHECK(calc_rat_parse("-170141183460469231731687303715884105728.5", &r) == 0 && r.inexact && r.approx < -1.7e38);
+    CHECK(calc_rat_parse("17014118346046923173168730371588410572.9", &r) == 0 && r.inexact && r.approx > 1.7e37);
+    CHECK(calc_rat_parse("1e39", &r) == 0 && r.inexact && calc_rat_parse("1e-39", &r) == 0 && r.inexact);
+
+    calc_rat_parse("1/3", &a);
+    calc_rat_parse("1/6", &b);
+    CHECK(calc_compute_rat(&ctx, &a, &b, CALC_OP_ADD, &r) == 0 && !r.inexact);
+    calc_rat_normalize(&r);
+    CHECK(r.num == 1 && r.den == 2);
+    CHECK(calc_compute_rat(&ctx, &a, &b, CALC_OP_SUB, &r) == 0 && (calc_rat_normalize(&r), r.num == 1 && r.den == 6));
+    CHECK(calc_compute_rat(&ctx, &a, &b, CALC_OP_MUL, &r) == 0 && (calc_rat_normalize(&r), r.num == 1 && r.den == 18));
+    CHECK(calc_compute_rat(&ctx, &a, &b, CALC_OP_DIV, &r) == 0 && (calc_rat_normalize(&r), r.num == 2 && r.den == 1));
+    calc_rat_from_int(&b, 0);
+    CHECK(calc_compute_rat(&ctx, &a, &b, CALC_OP_DIV, &r) == -1);
+
+    calc_rat_parse("-12.375", &r);
+    calc_rat_normalize(&r);
+    CHECK(r.num == -99 && r.den == 8);
+    CHECK(calc_rat_format(&ctx, &r, out, sizeof(out)) >= 0 && strncmp(out, "-99/8", 5) == 0);
+
+    /* 10^20 * 10^20 does not fit in 128 bits */
+    calc_rat_parse("100000000000000000000", &a);
+    CHECK(calc_compute_rat(&ctx, &a, &a, CALC_OP_MUL, &r) == 0 && r.inexact && r.approx == 1e40);
+    CHECK(calc_compute_rat(&ctx, &r, &a, CALC_OP_DIV, &r) == 0 && r.inexact && fabs(r.approx - 1e20) <= 1e5);
+}
+
+static void test_rat_from_double(void)
+{
+    calc_rat r;
+    double v = 0x1.123456789abcdp+70;
+
+    calc_rat_from_double(&r, -v);
+    CHECK(!r.inexact && r.num < 0 && calc_rat_value(&r) == -v);
+    calc_rat_from_double(&r, v);
+    CHECK(!r.inexact && r.num > 0 && calc_rat_value(&r) == v);
+}
+
+/* Saved sketches round-trip; a nonempty one without centroids is rejected */
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* Quantiles land within a fraction of a percent of rank of the sorted data, merged or not */
+static void test_sketch_accuracy(void)
+{
+    static calc_sketch whole, part[4];
+    static double data[200000], sorted[200000];
+    static const double qs[] = { 0.001, 0.01, 0.1, 0.25, 0.5, 0.75, 0.9, 0.99, 0.999 };
+    const int n = 200000;
+    double est;
+
+    calc_sketch_init(&whole);
+    for (int p = 0; p < 4; p++)
+        calc_sketch_init(&part[p]);
+    for (int i = 0; i < n; i++)
+    {
+        /* Skewed: normal body plus an exponential tail, in no particular order */
+        double u = calc_rand_uniform(7, (unsigned long long)i, 0);
+        data[i] = (i % 5 == 0) ? -log(1 - u) * 50 : calc_rand_normal(7, (unsigned long long)i, 1);
+        calc_sketch_add(&whole, data[i]);
+        calc_sketch_add(&part[i % 4], data[i]);
+    }
+    for (int p = 1; p < 4; p++)
+        calc_sketch_merge(&part[0], &part[p]);
+    memcpy(sorted, data, sizeof(data));
+    qsort(sorted, n, sizeof(sorted[0]), compare_doubles);
+
+    for (size_t k = 0; k < sizeof(qs) / sizeof(qs[0]); k++)
+        for (int m = 0; m < 2; m++)
+        {
+            CHECK(calc_sketch_quantile(m ? &part[0] : &whole, qs[k], &est) == 0);
+            /* Rank of the estimate in the exact data */
+            int lo = 0, hi = n;
+            while (lo < hi)
+            {
+                int mid = lo + (hi - lo) / 2;
+                if (sorted[mid] < est) lo = mid + 1; else hi = mid;
+            }
+            CHECK(fabs((double)lo / n - qs[k]) <= 0.002 + 0.01 * qs[k] * (1 - qs[k]));
+        }
+
+    double distinct = calc_sketch_distinct(&part[0]);
+    CHECK(fabs(distinct - n) <= 0.05 * n && distinct == calc_sketch_distinct(&whole));
+}
+
+static void test_sketch_load(void)
+{
+    static calc_sketch s, t;
+    static unsigned char buf[CALC_SKETCH_BYTES];
+    double q;
+
+    calc_sketch_init(&s);
+    for (int i = 1; i <= 1000; i++)
+        calc_sketch_add(&s, i);
+    size_t len = calc_sketch_save(&s, buf, sizeof(buf));
+    CHECK(len > 0 && calc_sketch_load(&t, buf, len) == 0);
+    CHECK(calc_sketch_quantile(&t, 0.5, &q) == 0 && q > 490 && q < 510);
+
+    calc_sketch_init(&s);
+    len = calc_sketch_save(&s, buf, sizeof(buf));
+    CHECK(calc_sketch_load(&t, buf, len) == 0);
+    buf[4 + 7] = 0x3f;  /* count = 1.0 in little-endian, still 0 centroids */
+    buf[4 + 6] = 0xf0;
+    CHECK(calc_sketch_load(&t, buf, len) == 2);
+}
+
+/* Roots match known ones, and products and column evaluation match the direct formulas */
+static void test_poly(void)
+{
+    static calc_poly p, q, r;
+    static double complex roots[CALC_POLY_MAX_DEGREE];
+    static double c[CALC_POLY_MAX_DEGREE + 2], x[100], out[100];
+
+    c[0] = -6; c[1] = 11; c[2] = -6; c[3] = 1;  /* (x - 1)(x - 2)(x - 3) */
+    CHECK(calc_poly_set(&p, c, 4) == 0 && calc_poly_roots(&p, roots) == 0);
+    for (int k = 1; k <= 3; k++)
+    {
+        int found = 0;
+        for (int i = 0; i < 3; i++)
+            found += cimag(roots[i]) == 0 && fabs(creal(roots[i]) - k) <= 1e-12;
+        CHECK(found == 1);
+    }
+
+    c[0] = 1; c[1] = 0; c[2] = 1;  /* x^2 + 1 */
+    CHECK(calc_poly_set(&p, c, 3) == 0 && calc_poly_roots(&p, roots) == 0);
+    CHECK(fabs(creal(roots[0])) <= 1e-15 && fabs(fabs(cimag(roots[0])) - 1) <= 1e-15);
+    CHECK(roots[1] == conj(roots[0]));
+
+    /* Roots of unity: x^64 - 1 */
+    c[0] = -1;
+    for (int i = 1; i < 64; i++)
+        c[i] = 0;
+    c[64] = 1;
+    CHECK(calc_poly_set(&p, c, 65) == 0 && calc_poly_roots(&p, roots) == 0);
+    for (int i = 0; i < 64; i++)
+        CHECK(fabs(cabs(roots[i]) - 1) <= 1e-13 && cabs(cpow(roots[i], 64) - 1) <= 1e-11);
+
+    /* Built as a product, so the test also runs calc_poly_mul(): roots 1..10 */
+    c[0] = 1;
+    CHECK(calc_poly_set(&p, c, 1) == 0);
+    for (int k = 1; k <= 10; k++)
+    {
+        double f[2] = { -k, 1 };
+        calc_poly_set(&q, f, 2);
+        CHECK(calc_poly_mul(&p, &q, &p) == 0);
+    }
+    CHECK(p.degree == 10 && p.c[0] == 3628800 && p.c[9] == -55);
+    CHECK(calc_poly_roots(&p, roots) == 0);
+    for (int i = 0; i < 10; i++)
+        CHECK(fabs(creal(roots[i]) - floor(creal(roots[i]) + 0.5)) <= 1e-6 && cimag(roots[i]) == 0);
+
+    c[0] = 0;
+    CHECK(calc_poly_set(&p, c, 1) == 0 && calc_poly_roots(&p, roots) == -2);
+    CHECK(calc_poly_set(&p, c, CALC_POLY_MAX_DEGREE + 2) == 0);
+    c[CALC_POLY_MAX_DEGREE + 1] = 1;
+    CHECK(calc_poly_set(&p, c, CALC_POLY_MAX_DEGREE + 2) == 4);
+
+    /* Degree 300 factors take the FFT path; compare with direct convolution */
+    for (int i = 0; i <= 300; i++)
+        c[i] = (i * 7919) % 13 - 6;
+    calc_poly_set(&p, c, 301);
+    for (int i = 0; i <= 300; i++)
+        c[i] = (i * 104729) % 11 - 4;
+    calc_poly_set(&q, c, 301);
+    CHECK(calc_poly_mul(&p, &q, &r) == 0 && r.degree == 600);
+    for (int k = 0; k <= 600; k++)
+    {
+        double direct = 0;
+        for (int i = 0; i <= k; i++)
+            if (i <= 300 && k - i <= 300)
+                direct += p.c[i] * q.c[k - i];
+        CHECK(fabs(r.c[k] - direct) <= 1e-9);
+    }
+
+    for (int i = 0; i < 100; i++)
+        x[i] = (i - 50) * 0.03;
+    calc_poly_eval_column(&r, x, out, 100);
+    for (int i = 0; i < 100; i++)
+        CHECK(out[i] == calc_poly_eval(&r, x[i]));
+    calc_poly_deriv(&p, &q);
+    CHECK(q.degree == 299 && q.c[0] == p.c[1] && q.c[299] == 300 * p.c[300]);
+}
+
+/* Programs from outside calc_compile() are range- and stack-checked */
+static void test_prog_check(void)
+{
+    calc_ctx ctx;
+    calc_prog prog, bad;
+
+    calc_init(&ctx);
+    calc_set_var(&ctx, "x", 0);
+    CHECK(compile(&ctx, "-(x + 1) * 2", &prog) == 0);
+    CHECK(calc_prog_check(&prog, ctx.var_count) == 0);
+
+    bad = prog;
+    bad.code[0].var = ctx.var_count;
+    CHECK(calc_prog_check(&bad, ctx.var_count) == 3);
+    bad = prog;
+    bad.code[bad.len - 1].op = CALC_OP_COUNT;
+    CHECK(calc_prog_check(&bad, ctx.var_count) == 1);
+    bad = prog;
+    bad.len--;                       /* leaves two values on the stack */
+    CHECK(calc_prog_check(&bad, ctx.var_count) == 2);
+    bad = prog;
+    bad.code[0] = bad.code[bad.len - 1];  /* an operator with an empty stack */
+    CHECK(calc_prog_check(&bad, ctx.var_count) == 2);
+    bad = prog;
+    bad.depth = 1;
+    CHECK(calc_prog_check(&bad, ctx.var_count) == 2);
+    bad = prog;
+    bad.code[1].kind = 7;
+    CHECK(calc_prog_check(&bad, ctx.var_count) == 2);
+}
+
+int main(void)
+{
+    test_complex();
+    test_grad();
+    test_solve();
+    test_formula_tiers();
+    test_sum();
+    test_rand_ranges();
+    test_montecarlo_seed();
+    test_compare_parse();
+    test_pipe();
+    test_rat_exact();
+    test_rat_from_double();
+    test_sketch_accuracy();
+    test_sketch_load();
+    test_poly();
+    test_prog_check();
+    if (failures)
+        printf("%d check(s) failed\n", failures);
+    else
+        printf("all checks passed\n");
+    return failures ? 1 : 0;
+}
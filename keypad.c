@@ -0,0 +1,218 @@
+/*
+ * Keypad engine - see keypad.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "keypad.h"
+
+static void add_history(keypad *kp, const char *line)
+{
+    if (kp->history_count >= KEYPAD_MAX_HISTORY)
+    {
+        memmove(kp->history[0], kp->history[1], sizeof(kp->history[0]) * (KEYPAD_MAX_HISTORY - 1));
+        kp->history_count = KEYPAD_MAX_HISTORY - 1;
+    }
+    size_t len = strlen(line);
+    if (len > KEYPAD_MAX_HIST_LINE - 1)
+        len = KEYPAD_MAX_HIST_LINE - 1;
+    memcpy(kp->history[kp->history_count], line, len);
+    kp->history[kp->history_count][len] = '\0';
+    kp->history_count++;
+}
+
+static double get_display_value(const keypad *kp)
+{
+    return atof(kp->display);
+}
+
+static void set_display_value(keypad *kp, double val)
+{
+    /* Format so negative numbers (e.g. -5) show clearly on main screen */
+    snprintf(kp->display, KEYPAD_MAX_DISPLAY, "%.12g", val);
+    char *p = strchr(kp->display, '.');
+    if (p && !strchr(p, 'e'))
+    {
+        size_t len = strlen(p);
+        while (len > 1 && p[len - 1] == '0') { p[--len] = '\0'; }
+        if (len == 1) *p = '\0';
+    }
+    /* Main-screen feedback: show this number as result (e.g. "Result: -5") */
+    snprintf(kp->last_result, KEYPAD_MAX_FEEDBACK, "Result: %s", kp->display);
+    kp->fresh_display = 1;
+}
+
+static void set_expression(keypad *kp, char op)
+{
+    if (op)
+        snprintf(kp->expression, KEYPAD_MAX_EXPR, "%.10g %c ", kp->operand1, op);
+    else
+        kp->expression[0] = '\0';
+}
+
+void keypad_init(keypad *kp)
+{
+    memset(kp, 0, sizeof(*kp));
+    calc_init(&kp->calc);
+    kp->calc.degree_mode = 1;
+    strcpy(kp->display, "0");
+    kp->fresh_display = 1;
+}
+
+void keypad_digit(keypad *kp, int digit)
+{
+    char c = (char)('0' + digit);
+    if (kp->fresh_display)
+    {
+        kp->display[0] = c;
+        kp->display[1] = '\0';
+        kp->fresh_display = 0;
+    }
+    else
+    {
+        size_t len = strlen(kp->display);
+        if (len < KEYPAD_MAX_DISPLAY - 1)
+        {
+            kp->display[len] = c;
+            kp->display[len + 1] = '\0';
+        }
+    }
+}
+
+void keypad_dot(keypad *kp)
+{
+    if (strchr(kp->display, '.')) return;
+    size_t len = strlen(kp->display);
+    if (len < KEYPAD_MAX_DISPLAY - 1)
+    {
+        if (kp->fresh_display) { strcpy(kp->display, "0."); kp->fresh_display = 0; }
+        else { kp->display[len] = '.'; kp->display[len + 1] = '\0'; }
+    }
+}
+
+void keypad_backspace(keypad *kp)
+{
+    if (kp->fresh_display) return;
+    size_t len = strlen(kp->display);
+    if (len <= 1)
+    {
+        strcpy(kp->display, "0");
+        kp->fresh_display = 1;
+    }
+    else
+    {
+        kp->display[len - 1] = '\0';
+    }
+}
+
+void keypad_clear(keypad *kp)
+{
+    strcpy(kp->display, "0");
+    kp->expression[0] = '\0';
+    kp->last_result[0] = '\0';
+    kp->fresh_display = 1;
+    kp->pending_op = 0;
+    kp->operand1 = 0;
+}
+
+int keypad_operator(keypad *kp, char op)
+{
+    double b = get_display_value(kp);
+
+    if (kp->pending_op)
+    {
+        char opstr[2] = { kp->pending_op, '\0' };
+        double result = 0;
+        if (calc_compute(&kp->calc, kp->operand1, b, opstr, &result) != 0)
+        {
+            strcpy(kp->display, "0");
+            kp->fresh_display = 1;
+            kp->pending_op = 0;
+            kp->expression[0] = '\0';
+            return -1;
+        }
+        set_display_value(kp, result);
+        if (op == '=')
+        {
+            char hist[KEYPAD_MAX_HIST_LINE];
+            snprintf(hist, sizeof(hist), "%.10g %c %.10g = %.12g", kp->operand1, kp->pending_op, b, result);
+            add_history(kp, hist);
+        }
+    }
+    else
+    {
+        kp->operand1 = b;
+    }
+
+    if (op == '=')
+    {
+        kp->pending_op = 0;
+        kp->expression[0] = '\0';
+    }
+    else
+    {
+        kp->pending_op = op;
+        kp->operand1 = get_display_value(kp);
+        kp->fresh_display = 1;
+        set_expression(kp, op);
+    }
+    return 0;
+}
+
+const char *keypad_func_name(int func)
+{
+    switch (func)
+    {
+        case KP_SQRT:   return "sqrt";
+        case KP_SQUARE: return "x^2";
+        case KP_RECIP:  return "1/x";
+        case KP_SIN:    return "sin";
+        case KP_COS:    return "cos";
+        case KP_TAN:    return "tan";
+        case KP_LN:     return "ln";
+        case KP_LOG:    return "log";
+        case KP_EXP:    return "exp";
+        case KP_ABS:    return "abs";
+        case KP_PI:     return "pi";
+        case KP_E:      return "e";
+        case KP_ASIN:   return "asin";
+        default: return "?";
+    }
+}
+
+int keypad_unary(keypad *kp, int func)
+{
+    double x = get_display_value(kp);
+    double result = 0;
+    int err;
+
+    if (func < 0 || func >= KP_FUNC_COUNT)
+        return 1;
+    if (func == KP_SQUARE)
+    {
+        result = x * x;
+        err = 0;
+    }
+    else
+    {
+        /* Calculator operator names match the key names except for 1/x */
+        err = calc_compute(&kp->calc, x, 0, func == KP_RECIP ? "inv" : keypad_func_name(func), &result);
+    }
+    if (err != 0)
+        return err;
+
+    set_display_value(kp, result);
+    kp->pending_op = 0;
+    kp->expression[0] = '\0';
+    {
+        char hist[KEYPAD_MAX_HIST_LINE];
+        const char *fn = keypad_func_name(func);
+        if (func == KP_PI || func == KP_E)
+            snprintf(hist, sizeof(hist), "%s = %.12g", fn, result);
+        else
+            snprintf(hist, sizeof(hist), "%s(%.10g) = %.12g", fn, x, result);
+        add_history(kp, hist);
+    }
+    return 0;
+}
@@ -0,0 +1,57 @@
+/*
+ * Keypad engine - the calculator GUI's button state machine without any UI
+ * Build: link keypad.c and calc.c into the front end (see CalculatorGUI.c)
+ *
+ * The front end forwards button presses to keypad_* and then redraws from
+ * display, expression and last_result. Everything lives in the keypad struct;
+ * the engine never allocates and has no globals.
+ */
+
+#ifndef KEYPAD_H
+#define KEYPAD_H
+
+#include "calc.h"
+
+#define KEYPAD_MAX_DISPLAY   80
+#define KEYPAD_MAX_EXPR      120
+#define KEYPAD_MAX_FEEDBACK  (KEYPAD_MAX_DISPLAY + 8)   /* "Result: " and the display */
+#define KEYPAD_MAX_HISTORY   50
+#define KEYPAD_MAX_HIST_LINE 120
+
+/* Unary function keys */
+enum
+{
+    KP_SQRT, KP_SQUARE, KP_RECIP, KP_ABS,
+    KP_SIN, KP_COS, KP_TAN, KP_ASIN,
+    KP_LN, KP_LOG, KP_EXP, KP_PI, KP_E,
+    KP_FUNC_COUNT
+};
+
+typedef struct keypad
+{
+    char display[KEYPAD_MAX_DISPLAY];
+    char expression[KEYPAD_MAX_EXPR];
+    char last_result[KEYPAD_MAX_FEEDBACK];  /* e.g. "Result: -5" for main-screen feedback */
+    double operand1;
+    char pending_op;
+    int fresh_display;
+    calc_ctx calc;                          /* calc.degree_mode: 1=deg, 0=rad */
+    char history[KEYPAD_MAX_HISTORY][KEYPAD_MAX_HIST_LINE];
+    int history_count;
+} keypad;
+
+void keypad_init(keypad *kp);
+void keypad_digit(keypad *kp, int digit);
+void keypad_dot(keypad *kp);
+void keypad_backspace(keypad *kp);
+void keypad_clear(keypad *kp);
+
+/* op is one of + - * / % ^ or '=' to finish. Returns 0, or -1 on division by zero (state is reset). */
+int keypad_operator(keypad *kp, char op);
+
+/* func is a KP_* key. Returns 0, or -1/-2 on invalid input (state is unchanged). */
+int keypad_unary(keypad *kp, int func);
+
+const char *keypad_func_name(int func);
+
+#endif
@@ -0,0 +1,163 @@
+/*
+ * Keypad replay - drives the keypad engine headless with recorded key events
+ * Build: gcc -O2 keypad_replay.c keypad.c calc.c -o keypad_replay -lm
+ * Count allocations (GNU ld): add -DCOUNT_ALLOCS -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc
+ * Usage: keypad_replay events.txt [repeat] [budget_ns]
+ *
+ * The event file holds whitespace-separated key names as printed on the GUI
+ * buttons: 0-9 . + - * / % ^ = C BS sqrt x^2 1/x |x| sin cos tan asin ln log exp pi e
+ * The whole file is replayed `repeat` times. With a budget, the exit status is
+ * 2 when the mean time per event exceeds budget_ns.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "keypad.h"
+
+#define EV_DOT     10
+#define EV_BS      11
+#define EV_CLEAR   12
+#define EV_OP      16   /* EV_OP + index into ops[] */
+#define EV_FUNC    32   /* EV_FUNC + KP_* */
+
+static const char ops[] = "+-*/%^=";
+
+#ifdef COUNT_ALLOCS
+static unsigned long alloc_count;
+void *__real_malloc(size_t n);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t n);
+void *__wrap_malloc(size_t n) { alloc_count++; return __real_malloc(n); }
+void *__wrap_calloc(size_t n, size_t size) { alloc_count++; return __real_calloc(n, size); }
+void *__wrap_realloc(void *p, size_t n) { alloc_count++; return __real_realloc(p, n); }
+#endif
+
+/* Returns the event code for a key name, or -1 if unknown */
+static int parse_key(const char *key)
+{
+    if (key[0] >= '0' && key[0] <= '9' && key[1] == '\0')
+        return key[0] - '0';
+    if (strcmp(key, ".") == 0)
+        return EV_DOT;
+    if (strcmp(key, "BS") == 0)
+        return EV_BS;
+    if (strcmp(key, "C") == 0)
+        return EV_CLEAR;
+    if (key[1] == '\0' && strchr(ops, key[0]))
+        return EV_OP + (int)(strchr(ops, key[0]) - ops);
+    if (strcmp(key, "|x|") == 0)
+        return EV_FUNC + KP_ABS;
+    for (int f = 0; f < KP_FUNC_COUNT; f++)
+        if (strcmp(key, keypad_func_name(f)) == 0)
+            return EV_FUNC + f;
+    if (strcmp(key, "1/x") == 0)
+        return EV_FUNC + KP_RECIP;
+    return -1;
+}
+
+static void apply(keypad *kp, unsigned char ev)
+{
+    if (ev < 10)
+        keypad_digit(kp, ev);
+    else if (ev == EV_DOT)
+        keypad_dot(kp);
+    else if (ev == EV_BS)
+        keypad_backspace(kp);
+    else if (ev == EV_CLEAR)
+        keypad_clear(kp);
+    else if (ev < EV_FUNC)
+        keypad_operator(kp, ops[ev - EV_OP]);
+    else
+        keypad_unary(kp, ev - EV_FUNC);
+}
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s events.txt [repeat] [budget_ns]\n", argv[0]);
+        return 1;
+    }
+    long repeat = (argc > 2) ? atol(argv[2]) : 1;
+    double budget_ns = (argc > 3) ? atof(argv[3]) : 0;
+    if (repeat < 1) repeat = 1;
+
+    FILE *f = fopen(argv[1], "r");
+    if (!f)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    /* Decode the recording once so the timed loop only touches the engine */
+    size_t count = 0, cap = 1024;
+    unsigned char *events = malloc(cap);
+    char key[16];
+    while (events && fscanf(f, "%15s", key) == 1)
+    {
+        int ev = parse_key(key);
+        if (ev < 0)
+        {
+            fprintf(stderr, "Unknown key '%s' at event %zu\n", key, count);
+            free(events);
+            fclose(f);
+            return 1;
+        }
+        if (count == cap)
+        {
+            unsigned char *grown = realloc(events, cap * 2);
+            if (!grown) { free(events); events = NULL; break; }
+            events = grown;
+            cap *= 2;
+        }
+        events[count++] = (unsigned char)ev;
+    }
+    fclose(f);
+    if (!events || count == 0)
+    {
+        fprintf(stderr, events ? "No events in %s\n" : "Out of memory reading %s\n", argv[1]);
+        free(events);
+        return 1;
+    }
+
+    keypad kp;
+    keypad_init(&kp);
+
+#ifdef COUNT_ALLOCS
+    unsigned long allocs_before = alloc_count;
+#endif
+    double t0 = now_sec();
+    for (long r = 0; r < repeat; r++)
+        for (size_t i = 0; i < count; i++)
+            apply(&kp, events[i]);
+    double elapsed = now_sec() - t0;
+
+    double total = (double)count * (double)repeat;
+    double ns_per_event = elapsed * 1e9 / total;
+    printf("Events:      %.0f (%zu x %ld)\n", total, count, repeat);
+    printf("Time:        %.3f s\n", elapsed);
+    printf("Throughput:  %.0f events/sec\n", total / elapsed);
+    printf("Mean:        %.1f ns/event\n", ns_per_event);
+#ifdef COUNT_ALLOCS
+    printf("Allocations: %lu\n", alloc_count - allocs_before);
+#endif
+    printf("Display:     %s\n", kp.display);
+    free(events);
+
+    if (budget_ns > 0 && ns_per_event > budget_ns)
+    {
+        printf("Over budget: %.1f ns/event > %.1f ns\n", ns_per_event, budget_ns);
+        return 2;
+    }
+    return 0;
+}